@@ -0,0 +1,572 @@
+// Microbenchmarks of the loader, the mesh builders, the per face transform
+// and cull loop and the rasterizer, on a headless framebuffer.
+//
+//     SimpleGLBenchmarks [--objects <dir>] [--json <path>] [--filter <text>]
+//                        [--repetitions <count>] [--simd scalar|sse2|avx2|avx512]
+//                        [--verify]
+//
+// Every benchmark is warmed up first, then timed over --repetitions runs of
+// enough iterations to last kMinRepetitionTime each. The JSON output holds
+// the build configuration and per benchmark statistics, to compare builds.
+//
+// --verify runs no benchmark, it checks instead that every span kernel level
+// the CPU supports draws the same framebuffer as the scalar one, that
+// hierarchical Z changes no pixel, and that every OBJ loads the same with
+// one thread and with several, and exits with 1 if one does not.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "clipping.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "mesh.h"
+#include "objloader.h"
+#include "rasterizer.h"
+#include "spankernels.h"
+#include "vec.h"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kWarmUpTime = std::chrono::milliseconds(100);
+constexpr auto kMinRepetitionTime = std::chrono::milliseconds(20);
+constexpr int kDefaultRepetitions = 10;
+
+// Same screen and camera as the viewer
+constexpr int kWidth = 1920;
+constexpr int kHeight = 1080;
+constexpr double kFovFactor = 640.0;
+constexpr double kNearPlane = 0.1;
+constexpr double kFarPlane = 100.0;
+constexpr double kCameraDistance = 5.0;
+constexpr double kMeshScale = 0.25;
+
+struct Options {
+    std::string objectsPath = "../objects";
+    std::string jsonPath;
+    std::string filter;
+    int repetitions = kDefaultRepetitions;
+    bool verify = false;
+};
+
+struct Result {
+    std::string name;
+    // Throughput unit, per second
+    std::string unit;
+    double itemsPerIteration = 0.0;
+    long iterations = 0;
+    // Milliseconds per iteration, one sample per repetition
+    std::vector<double> samplesMs;
+    double medianMs = 0.0;
+    double meanMs = 0.0;
+    double stddevMs = 0.0;
+    double minMs = 0.0;
+
+    // Items per second at the median time
+    double throughput() const {
+        return medianMs > 0.0 ? itemsPerIteration/(medianMs/1000.0) : 0.0;
+    }
+};
+
+Options options;
+std::vector<Result> results;
+
+// Keeps results alive so the compiler cannot drop the work producing them
+volatile size_t sink = 0;
+
+void summarize(Result & result) {
+    std::vector<double> sorted = result.samplesMs;
+    std::sort(sorted.begin(), sorted.end());
+    const size_t count = sorted.size();
+    result.medianMs = count % 2 ? sorted[count/2] : (sorted[count/2 - 1] + sorted[count/2])/2.0;
+    result.minMs = sorted.front();
+
+    double sum = 0.0;
+    for (double sample : sorted) sum += sample;
+    result.meanMs = sum/count;
+
+    double squares = 0.0;
+    for (double sample : sorted) squares += (sample - result.meanMs)*(sample - result.meanMs);
+    result.stddevMs = count > 1 ? std::sqrt(squares/(count - 1)) : 0.0;
+}
+
+// Runs body, which does itemsPerIteration units of work per call.
+template <typename Body>
+void benchmark(std::string const & name, std::string const & unit, double itemsPerIteration, Body && body) {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    // Warm up caches, the allocator and the branch predictors, and find how
+    // many iterations fill a repetition
+    long warmUpIterations = 0;
+    const auto warmUpStart = Clock::now();
+    do {
+        body();
+        ++warmUpIterations;
+    } while (Clock::now() - warmUpStart < kWarmUpTime);
+    const double iterationTime = std::chrono::duration<double>(Clock::now() - warmUpStart).count()/warmUpIterations;
+    const long iterations = std::max(1L, static_cast<long>(std::ceil(std::chrono::duration<double>(kMinRepetitionTime).count()/iterationTime)));
+
+    Result result;
+    result.name = name;
+    result.unit = unit;
+    result.itemsPerIteration = itemsPerIteration;
+    result.iterations = iterations;
+
+    for (int repetition = 0; repetition < options.repetitions; ++repetition) {
+        const auto start = Clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            body();
+        }
+        result.samplesMs.emplace_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations);
+    }
+    summarize(result);
+
+    std::cout << std::left << std::setw(36) << name << std::right
+              << std::setw(12) << std::setprecision(4) << result.medianMs << " ms"
+              << " +- " << std::setw(8) << std::setprecision(3) << result.stddevMs
+              << std::setw(14) << std::setprecision(4) << result.throughput() << ' ' << unit << '\n';
+    results.emplace_back(std::move(result));
+}
+
+simplegl::mat4d_t cameraTransform() {
+    return
+        simplegl::mat4d_t::viewport(kWidth, kHeight) *
+        simplegl::mat4d_t::perspective(2.0*std::atan(kHeight/2/kFovFactor), double(kWidth)/kHeight, kNearPlane, kFarPlane) *
+        simplegl::mat4d_t::translation({0.0, 0.0, kCameraDistance}) *
+        simplegl::mat4d_t::scale(kMeshScale) *
+        simplegl::mat4d_t::rotationY(0.5) *
+        simplegl::mat4d_t::rotationX(0.3);
+}
+
+void benchmarkObjLoader(std::vector<std::filesystem::path> const & objects) {
+    for (auto const & path : objects) {
+        const double megabytes = std::filesystem::file_size(path)/1e6;
+        benchmark("ObjLoader::load/" + path.filename().string(), "MB/s", megabytes, [&]() {
+            auto mesh = simplegl::ObjLoader::load(path.string());
+            sink = mesh ? mesh->faces().size() : 0;
+        });
+    }
+}
+
+void benchmarkMeshBuilders() {
+    for (unsigned level : {10u, 30u, 100u, 300u}) {
+        const double vertexes = static_cast<double>(simplegl::Mesh::buildSphere(level).vertices().size());
+        benchmark("Mesh::buildSphere/" + std::to_string(level), "vertices/s", vertexes, [level]() {
+            sink = simplegl::Mesh::buildSphere(level).vertices().size();
+        });
+    }
+    for (unsigned level : {10u, 100u, 1000u, 10000u}) {
+        const double vertexes = static_cast<double>(simplegl::Mesh::buildCylinder(level).vertices().size());
+        benchmark("Mesh::buildCylinder/" + std::to_string(level), "vertices/s", vertexes, [level]() {
+            sink = simplegl::Mesh::buildCylinder(level).vertices().size();
+        });
+    }
+}
+
+// The per face loop of the viewer's update(), without the meshlets: every
+// vertex transformed, then every face culled and clipped.
+void benchmarkTransformCull(std::string const & name, simplegl::Mesh const & mesh) {
+    const simplegl::PositionArrays positions = simplegl::toPositionArrays(mesh.vertices());
+    const simplegl::mat4_t transform = simplegl::matCast<simplegl::scalar_t>(cameraTransform());
+    const simplegl::ClipVolume volume = {kWidth, kHeight, kNearPlane, kFarPlane, simplegl::kMaxRasterCoordinate/2};
+
+    simplegl::ClipPositionArrays clipVertices;
+    std::vector<simplegl::vec3_t> vertexes;
+    std::vector<uint8_t> edgeMasks;
+
+    benchmark("transform+cull/" + name, "triangles/s", static_cast<double>(mesh.faces().size()), [&]() {
+        vertexes.clear();
+        edgeMasks.clear();
+        simplegl::transformPositions(transform, positions, clipVertices);
+        for (simplegl::Face const & face : mesh.faces()) {
+            const simplegl::vec4_t a = clipVertices.at(face.indexes[0].vertex);
+            const simplegl::vec4_t b = clipVertices.at(face.indexes[1].vertex);
+            const simplegl::vec4_t c = clipVertices.at(face.indexes[2].vertex);
+            if (!simplegl::backFacing(a, b, c)) {
+                simplegl::clipTriangle(volume, a, b, c, vertexes, edgeMasks);
+            }
+        }
+        sink = vertexes.size();
+    });
+}
+
+struct Triangle {
+    simplegl::vec3_t a;
+    simplegl::vec3_t b;
+    simplegl::vec3_t c;
+};
+
+// Seeded, so every build rasterizes the same triangles
+std::vector<Triangle> randomTriangles(size_t count, double size) {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<double> x(size, kWidth - size);
+    std::uniform_real_distribution<double> y(size, kHeight - size);
+    std::uniform_real_distribution<double> offset(-size, size);
+    std::uniform_real_distribution<double> depth(0.2, 1.0);
+
+    std::vector<Triangle> triangles;
+    for (size_t i = 0; i < count; ++i) {
+        const double cx = x(random);
+        const double cy = y(random);
+        const double z = depth(random);
+        auto vertex = [&]() {
+            return simplegl::vecCast<simplegl::scalar_t>(simplegl::vec3d_t{cx + offset(random), cy + offset(random), z});
+        };
+        Triangle triangle{vertex(), vertex(), vertex()};
+        // Counterclockwise like the mesh faces
+        if ((triangle.b.x - triangle.a.x)*(triangle.c.y - triangle.a.y) - (triangle.b.y - triangle.a.y)*(triangle.c.x - triangle.a.x) < 0) {
+            std::swap(triangle.b, triangle.c);
+        }
+        triangles.emplace_back(triangle);
+    }
+    return triangles;
+}
+
+double area(std::vector<Triangle> const & triangles) {
+    double total = 0.0;
+    for (Triangle const & t : triangles) {
+        total += std::abs((t.b.x - t.a.x)*(t.c.y - t.a.y) - (t.b.y - t.a.y)*(t.c.x - t.a.x))/2.0;
+    }
+    return total;
+}
+
+void benchmarkRaster() {
+    simplegl::Framebuffer framebuffer(kWidth, kHeight);
+    const simplegl::Rect bounds = framebuffer.bounds();
+    constexpr uint32_t color = 0xFFFFFFFF;
+
+    for (double size : {4.0, 32.0, 128.0}) {
+        const std::vector<Triangle> triangles = randomTriangles(1000, size);
+        const double pixels = area(triangles);
+        const std::string suffix = "/" + std::to_string(static_cast<int>(size)) + "px";
+
+        benchmark("fillTriangle/edge" + suffix, "pixels/s", pixels, [&]() {
+            for (Triangle const & t : triangles) {
+                simplegl::fillTriangle(framebuffer, {t.a.x, t.a.y}, {t.b.x, t.b.y}, {t.c.x, t.c.y}, color, bounds);
+            }
+        });
+
+        // The depth buffer is cleared every iteration, or hierarchical Z
+        // would reject everything after the first one
+        simplegl::RasterStats stats;
+        benchmark("fillTriangle/edge+depth" + suffix, "pixels/s", pixels, [&]() {
+            framebuffer.clearDepthBuffer();
+            for (Triangle const & t : triangles) {
+                simplegl::fillTriangle(framebuffer, t.a, t.b, t.c, color, bounds, stats);
+            }
+        });
+
+        benchmark("fillTriangle/scanline" + suffix, "pixels/s", pixels, [&]() {
+            for (Triangle const & t : triangles) {
+                framebuffer.fillTriangle(
+                    static_cast<int>(t.a.x), static_cast<int>(t.a.y),
+                    static_cast<int>(t.b.x), static_cast<int>(t.b.y),
+                    static_cast<int>(t.c.x), static_cast<int>(t.c.y),
+                    color, bounds);
+            }
+        });
+
+        double linePixels = 0.0;
+        for (Triangle const & t : triangles) {
+            linePixels += std::max(std::abs(static_cast<int>(t.b.x) - static_cast<int>(t.a.x)), std::abs(static_cast<int>(t.b.y) - static_cast<int>(t.a.y))) + 1;
+        }
+        benchmark("drawLine" + suffix, "pixels/s", linePixels, [&]() {
+            for (Triangle const & t : triangles) {
+                framebuffer.drawLine(
+                    static_cast<int>(t.a.x), static_cast<int>(t.a.y),
+                    static_cast<int>(t.b.x), static_cast<int>(t.b.y),
+                    color, bounds);
+            }
+        });
+    }
+
+    benchmark("clearColorBuffer", "pixels/s", double(kWidth)*kHeight, [&]() {
+        framebuffer.clearColorBuffer(0xFF000000);
+    });
+}
+
+// Fill paths --verify compares, each drawn into its own framebuffer
+constexpr std::array<std::string_view, 3> kVerifyPaths = {"edge", "edge+depth", "scanline"};
+
+// Draws the benchmark triangles with one fill path, each triangle in its own
+// color so the depth test decides which one stays visible.
+void drawVerifyScene(simplegl::Framebuffer & framebuffer, std::string_view path) {
+    const simplegl::Rect bounds = framebuffer.bounds();
+    framebuffer.clearColorBuffer(0xFF000000);
+    framebuffer.clearDepthBuffer();
+
+    simplegl::RasterStats stats;
+    uint32_t color = 0xFF000001;
+    for (double size : {4.0, 32.0, 128.0}) {
+        for (Triangle const & t : randomTriangles(1000, size)) {
+            if (path == "edge") {
+                simplegl::fillTriangle(framebuffer, {t.a.x, t.a.y}, {t.b.x, t.b.y}, {t.c.x, t.c.y}, color, bounds);
+            } else if (path == "edge+depth") {
+                simplegl::fillTriangle(framebuffer, t.a, t.b, t.c, color, bounds, stats);
+            } else {
+                framebuffer.fillTriangle(
+                    static_cast<int>(t.a.x), static_cast<int>(t.a.y),
+                    static_cast<int>(t.b.x), static_cast<int>(t.b.y),
+                    static_cast<int>(t.c.x), static_cast<int>(t.c.y),
+                    color, bounds);
+            }
+            ++color;
+        }
+    }
+}
+
+bool sameFramebuffers(simplegl::Framebuffer & a, simplegl::Framebuffer & b) {
+    if (a.colorBuffer() != b.colorBuffer()) {
+        return false;
+    }
+    for (int y = 0; y < a.height(); ++y) {
+        if (std::memcmp(a.depthRow(y), b.depthRow(y), a.width()*sizeof(float)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false if a supported level draws differently from the scalar one.
+bool verifySpanKernels() {
+    const simplegl::SimdLevel selected = simplegl::spanKernels().level;
+
+    bool identical = true;
+    simplegl::Framebuffer reference(kWidth, kHeight);
+    simplegl::Framebuffer framebuffer(kWidth, kHeight);
+    for (std::string_view path : kVerifyPaths) {
+        simplegl::selectSpanKernels(simplegl::SimdLevel::Scalar);
+        drawVerifyScene(reference, path);
+
+        for (simplegl::SimdLevel level : {simplegl::SimdLevel::SSE2, simplegl::SimdLevel::AVX2, simplegl::SimdLevel::AVX512}) {
+            std::cout << std::left << std::setw(36) << "span kernels/" + std::string(simplegl::toString(level)) + "/" + std::string(path);
+            if (!simplegl::selectSpanKernels(level)) {
+                std::cout << "not supported\n";
+                continue;
+            }
+            drawVerifyScene(framebuffer, path);
+            const bool same = sameFramebuffers(reference, framebuffer);
+            std::cout << (same ? "identical" : "DIFFERENT") << '\n';
+            identical = identical && same;
+        }
+    }
+
+    simplegl::selectSpanKernels(selected);
+    return identical;
+}
+
+// A screen sized quad and the seeded triangles over it, all on one almost
+// flat plane, so the triangles tie with the stored depth up to the rounding
+// of the depth kernels.
+std::vector<Triangle> coplanarTriangles(size_t count, double size) {
+    const simplegl::vec3_t corners[4] = {{0, 0, 0}, {kWidth, 0, 0}, {kWidth, kHeight, 0}, {0, kHeight, 0}};
+    std::vector<Triangle> triangles = {{corners[0], corners[1], corners[2]}, {corners[0], corners[2], corners[3]}};
+    for (Triangle const & t : randomTriangles(count, size)) {
+        triangles.emplace_back(t);
+    }
+    for (Triangle & t : triangles) {
+        for (simplegl::vec3_t * vertex : {&t.a, &t.b, &t.c}) {
+            vertex->z = static_cast<simplegl::scalar_t>(0.3 + 1e-9*vertex->x + 7e-10*vertex->y);
+        }
+    }
+    return triangles;
+}
+
+// Returns false if hierarchical Z changes what the depth tested path draws.
+bool verifyHiZ() {
+    bool identical = true;
+    simplegl::Framebuffer reference(kWidth, kHeight);
+    simplegl::Framebuffer framebuffer(kWidth, kHeight);
+    reference.setHiZEnabled(false);
+
+    for (bool coplanar : {false, true}) {
+        for (double size : {4.0, 32.0, 128.0}) {
+            const std::vector<Triangle> triangles = coplanar ? coplanarTriangles(1000, size) : randomTriangles(1000, size);
+            for (simplegl::Framebuffer * target : {&reference, &framebuffer}) {
+                target->clearColorBuffer(0xFF000000);
+                target->clearDepthBuffer();
+                simplegl::RasterStats stats;
+                uint32_t color = 0xFF000001;
+                for (Triangle const & t : triangles) {
+                    simplegl::fillTriangle(*target, t.a, t.b, t.c, color++, target->bounds(), stats);
+                }
+            }
+
+            const std::string name = std::string("hi-z/") + (coplanar ? "coplanar/" : "random/") + std::to_string(static_cast<int>(size)) + "px";
+            const bool same = sameFramebuffers(reference, framebuffer);
+            std::cout << std::left << std::setw(36) << name << (same ? "identical" : "DIFFERENT") << '\n';
+            identical = identical && same;
+        }
+    }
+    return identical;
+}
+
+template <typename T>
+bool sameBytes(std::span<T const> a, std::span<T const> b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size_bytes()) == 0;
+}
+
+// Returns false if an OBJ loads differently with several threads than with
+// one.
+bool verifyObjLoader(std::vector<std::filesystem::path> const & objects) {
+    const unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+
+    bool identical = true;
+    for (auto const & path : objects) {
+        std::cout << std::left << std::setw(36) << "ObjLoader::load/" + path.filename().string();
+        const auto single = simplegl::ObjLoader::load(path.string(), 1);
+        const auto parallel = simplegl::ObjLoader::load(path.string(), threads);
+        if (!single || !parallel) {
+            std::cout << "cannot load\n";
+            identical = false;
+            continue;
+        }
+        const bool same =
+            sameBytes(single->vertices(), parallel->vertices()) &&
+            sameBytes(single->textureUVs(), parallel->textureUVs()) &&
+            sameBytes(single->normals(), parallel->normals()) &&
+            sameBytes(single->faces(), parallel->faces());
+        std::cout << (same ? "identical" : "DIFFERENT") << " with " << threads << " threads\n";
+        identical = identical && same;
+    }
+    return identical;
+}
+
+void writeJsonString(std::ostream & out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+bool writeJson(std::string const & path) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write " << path << '\n';
+        return false;
+    }
+
+    out << std::setprecision(9);
+    out << "{\n  \"build\": {\"scalar\": \"" << (sizeof(simplegl::scalar_t) == sizeof(float) ? "float" : "double") << "\", "
+        << "\"simd\": \"" << simplegl::toString(simplegl::spanKernels().level) << "\", "
+        << "\"compiler\": ";
+    writeJsonString(out, __VERSION__);
+    out << "},\n  \"benchmarks\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        Result const & result = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": ";
+        writeJsonString(out, result.name);
+        out << ", \"unit\": \"" << result.unit << "\""
+            << ", \"iterations\": " << result.iterations
+            << ", \"repetitions\": " << result.samplesMs.size()
+            << ", \"median_ms\": " << result.medianMs
+            << ", \"mean_ms\": " << result.meanMs
+            << ", \"stddev_ms\": " << result.stddevMs
+            << ", \"min_ms\": " << result.minMs
+            << ", \"throughput\": " << result.throughput()
+            << ", \"samples_ms\": [";
+        for (size_t s = 0; s < result.samplesMs.size(); ++s) {
+            out << (s ? ", " : "") << result.samplesMs[s];
+        }
+        out << "]}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--objects" && hasValue) {
+            options.objectsPath = argv[++i];
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--repetitions" && hasValue) {
+            options.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg == "--simd" && hasValue && simplegl::simdLevelFromString(argv[i + 1])) {
+            if (!simplegl::selectSpanKernels(*simplegl::simdLevelFromString(argv[++i]))) {
+                std::cerr << argv[i] << " is not supported by this CPU\n";
+                return false;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--objects <dir>] [--json <path>] [--filter <text>] [--repetitions <count>] [--simd scalar|sse2|avx2|avx512] [--verify]\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        return 1;
+    }
+
+    std::vector<std::filesystem::path> objects;
+    std::error_code error;
+    for (auto const & entry : std::filesystem::directory_iterator(options.objectsPath, error)) {
+        if (entry.path().extension() == ".obj") {
+            objects.emplace_back(entry.path());
+        }
+    }
+    if (error) {
+        std::cerr << "Cannot list " << options.objectsPath << ": " << error.message() << '\n';
+        return 1;
+    }
+    std::sort(objects.begin(), objects.end());
+
+    if (options.verify) {
+        const bool kernelsIdentical = verifySpanKernels();
+        const bool hiZIdentical = verifyHiZ();
+        const bool loaderIdentical = verifyObjLoader(objects);
+        return kernelsIdentical && hiZIdentical && loaderIdentical ? 0 : 1;
+    }
+
+    std::cout << simplegl::toString(simplegl::spanKernels().level) << " kernels, "
+              << (sizeof(simplegl::scalar_t) == sizeof(float) ? "float" : "double") << " geometry, "
+              << options.repetitions << " repetitions, median ms per iteration\n";
+
+    benchmarkObjLoader(objects);
+    benchmarkMeshBuilders();
+    for (auto const & path : objects) {
+        if (auto mesh = simplegl::ObjLoader::load(path.string())) {
+            benchmarkTransformCull(path.filename().string(), *mesh);
+        }
+    }
+    benchmarkTransformCull("sphere/300", simplegl::Mesh::buildSphere(300));
+    benchmarkRaster();
+
+    if (!options.jsonPath.empty() && !writeJson(options.jsonPath)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "mesh.h"
+#include "meshlet.h"
+
+namespace simplegl
+{
+
+// Neighbor of a face along an edge no other face uses
+constexpr uint32_t kNoFace = UINT32_MAX;
+
+// Face across edges ab, bc and ca of a face, see kTriangleEdgeAB. Walking
+// the faces in order, an edge is new to the wireframe unless its neighbor
+// comes earlier and was drawn, so each edge is drawn once.
+using FaceNeighbors = std::array<uint32_t, 3>;
+
+// Neighbors of every face of a triangle list, three vertex indexes per face.
+// Faces sharing an edge with more than two others are paired up in order.
+std::vector<FaceNeighbors> buildFaceNeighbors(std::span<uint32_t const> triangles);
+
+// By position index, faces in mesh order.
+std::vector<FaceNeighbors> buildFaceNeighbors(Mesh const & mesh);
+
+// By index into MeshletMesh::positions, faces numbered in meshlet order.
+std::vector<FaceNeighbors> buildFaceNeighbors(MeshletMesh const & meshlets);
+
+}
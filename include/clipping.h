@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "vec.h"
+
+namespace simplegl
+{
+
+// Visible part of clip space for a projection straight to pixels: x/w in
+// [0, width], y/w in [0, height] and w, the view depth, in [near, far].
+//
+// Triangles crossing a screen edge but staying within guardBand pixels of
+// the screen are passed on whole: the rasterizer clips them to the screen
+// for free through its bounding box. Only triangles reaching beyond the
+// guard band are clipped against its sides, which keeps every vertex within
+// what the rasterizer can represent. Keep width + guardBand below
+// kMaxRasterCoordinate.
+struct ClipVolume {
+    double width = 0.0;
+    double height = 0.0;
+    double near = 0.0;
+    double far = 0.0;
+    double guardBand = 0.0;
+};
+
+enum class ClipResult {
+    Rejected,   // entirely outside the frustum, nothing appended
+    Inside,     // appended as it is
+    Clipped     // cut by the near plane or the guard band, appended as a fan
+};
+
+// Whether the clip space triangle abc faces away from the camera. The
+// determinant of the clip x, y and w rows has the sign of the view space
+// triple product, no divide needed.
+bool backFacing(vec4_t const & a, vec4_t const & b, vec4_t const & c);
+
+// Clips the clip space triangle abc and appends what is left as screen space
+// triangles, pixel x and y with the inverse view depth 1/w in z, three
+// vertexes per triangle, with one edge mask per triangle telling which of its
+// edges belong to abc (see kTriangleEdgeAB).
+ClipResult clipTriangle(ClipVolume const & volume, vec4_t const & a, vec4_t const & b, vec4_t const & c, std::vector<vec3_t> & vertexes, std::vector<uint8_t> & edgeMasks);
+
+// Same for the clip space segment ab: rejected when entirely outside the
+// frustum, cut by the near plane and the guard band, and appended as two
+// screen space vertexes, in the same order whichever way round a and b are
+// given. Returns false when nothing was appended.
+bool clipLine(ClipVolume const & volume, vec4_t const & a, vec4_t const & b, std::vector<vec3_t> & vertexes);
+
+// The planes clipTriangle() rejects against, brought back to the space
+// modelToClip maps from. Inside where dot(xyz, p) + w >= 0, xyz of unit
+// length so the value is a distance.
+using FrustumPlanes = std::array<vec4d_t, 6>;
+
+FrustumPlanes frustumPlanes(ClipVolume const & volume, mat4d_t const & modelToClip);
+
+// Whether the sphere lies entirely outside one of the planes.
+bool sphereOutside(FrustumPlanes const & planes, vec3d_t const & center, double radius);
+
+}
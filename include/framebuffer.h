@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "vec.h"
+
+namespace simplegl
+{
+
+// Side of the square pixel blocks tracked by the hierarchical Z buffer.
+constexpr int kHiZBlockSize = 8;
+
+// Edge bits of a triangle abc for drawTriangle: ab, bc and ca. Triangles cut
+// out of a clipped one leave the edges along the cut undrawn.
+constexpr uint8_t kTriangleEdgeAB = 1;
+constexpr uint8_t kTriangleEdgeBC = 2;
+constexpr uint8_t kTriangleEdgeCA = 4;
+constexpr uint8_t kAllTriangleEdges = kTriangleEdgeAB | kTriangleEdgeBC | kTriangleEdgeCA;
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1) in drawPixel's coordinates.
+struct Rect {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+};
+
+// CPU side render target. Owns the ARGB8888 color buffer, the depth buffer and
+// every raster call, so it can be used without SDL (headless rendering,
+// benchmarks) and presented by a Window when one exists.
+//
+// Depth is stored as inverse view depth (1/z): it interpolates linearly in
+// screen space, larger values are closer and the cleared value 0 is infinitely
+// far away. Next to it a coarse hierarchical Z buffer keeps, per
+// kHiZBlockSize^2 block, the farthest depth stored in the block so occluded
+// geometry can be rejected without reading the depth buffer.
+struct Framebuffer {
+
+Framebuffer(int width, int height);
+
+void drawPixel(int x, int y, uint32_t pixel_value);
+
+void clearColorBuffer(uint32_t color);
+
+void clearDepthBuffer();
+
+// Snapshots the color buffer as the static background of every frame (the
+// grid, for instance), so it is drawn once instead of once per frame.
+void captureBackground();
+
+// Starts a frame: copies the captured background into the color buffer and
+// clears the depth buffer, inside clip only for the second overload. Bulk
+// row copies, no per pixel work. captureBackground() must have been called.
+void restoreBackground();
+
+void restoreBackground(Rect const & clip);
+
+void drawGrid(int multiple);
+
+void drawRectangle(int x_pos, int y_pos, int width, int height, uint32_t color);
+
+// The overloads taking a clip rect only write pixels inside it, clip must lie
+// within bounds(). They let several threads draw disjoint parts of a frame.
+// Lines are integer Bresenham lines and cover the same pixels whatever the
+// clip.
+
+void drawLine(int x0, int y0, int x1, int y1, uint32_t color);
+
+void drawLine(int x0, int y0, int x1, int y1, uint32_t color, Rect const & clip);
+
+void drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
+
+void drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip, uint8_t edges = kAllTriangleEdges);
+
+// Lines between vertexes in pixel coordinates. Every endpoint goes to the
+// pixel holding it, the floor of its coordinates as for the fill
+// rasterizer's pixel centers, so guard band vertexes left of or below the
+// screen land on the same pixels as the filled edges they outline.
+
+void drawLine(vec2_t const & a, vec2_t const & b, uint32_t color, Rect const & clip);
+
+void drawTriangle(vec2_t const & a, vec2_t const & b, vec2_t const & c, uint32_t color, Rect const & clip, uint8_t edges = kAllTriangleEdges);
+
+// Returns the number of pixels written.
+int fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
+
+int fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip);
+
+// Depth tested wireframe: z holds the inverse depth of each endpoint, lines
+// slightly behind the stored depth still pass so edges of visible faces are
+// not lost to depth buffer precision. The depth buffer is not written.
+
+void drawLine(int x0, int y0, double z0, int x1, int y1, double z1, uint32_t color, Rect const & clip);
+
+void drawLine(vec3_t const & a, vec3_t const & b, uint32_t color, Rect const & clip);
+
+void drawTriangle(vec3_t const & a, vec3_t const & b, vec3_t const & c, uint32_t color, Rect const & clip, uint8_t edges = kAllTriangleEdges);
+
+// Writes the color buffer as a binary PPM (P6), top row first.
+bool writePPM(std::string_view path) const;
+
+int width() const {
+    return _width;
+}
+
+int height() const {
+    return _height;
+}
+
+Rect bounds() const {
+    return Rect{0, 0, _width, _height};
+}
+
+// Start of row y in drawPixel's coordinates (y grows upwards), no bounds check.
+uint32_t* row(int y) {
+    return colorTarget() + _color_pitch*(_height - 1 - y);
+}
+
+float* depthRow(int y) {
+    return _depth_buffer.data() + static_cast<size_t>(_width)*(_height - 1 - y);
+}
+
+int hiZBlocksX() const {
+    return _hiz_blocks_x;
+}
+
+// Farthest depth stored in block (blockX, blockY), refreshed from the depth
+// buffer if the block was written since the last query. Minus infinity,
+// which rejects nothing, while hierarchical Z is disabled.
+float hiZ(int blockX, int blockY);
+
+// On by default. Off, only the per pixel depth test remains, which must draw
+// the same pixels.
+void setHiZEnabled(bool enabled) {
+    _hiz_enabled = enabled;
+}
+
+// Call after writing depth inside the block.
+void invalidateHiZ(int blockX, int blockY) {
+    _hiz_dirty[static_cast<size_t>(blockY)*_hiz_blocks_x + blockX] = 1;
+}
+
+// The framebuffer's own color buffer, top row first, which is drawn into
+// unless a color target is set.
+std::vector<uint32_t>& colorBuffer() {
+    return _color_buffer;
+}
+
+std::vector<uint32_t> const & colorBuffer() const {
+    return _color_buffer;
+}
+
+// Draws into pixels instead until resetColorTarget(), a locked streaming
+// texture for instance, so a frame needs no copy to reach it. pixels holds
+// height() rows of at least width() pixels, top row first and pitch bytes
+// apart. The depth buffer stays the framebuffer's own.
+void setColorTarget(uint32_t* pixels, int pitch);
+
+void resetColorTarget();
+
+private:
+
+uint32_t* colorTarget() {
+    return _color_target ? _color_target : _color_buffer.data();
+}
+
+// Without lastRow the row of y1 and y2 is left to the flat top half
+int fillFlatBottomTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip, bool lastRow = true);
+int fillFlatTopTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip);
+
+int _width = 0;
+int _height = 0;
+std::vector<uint32_t> _color_buffer;
+// Pixels drawn into when not _color_buffer, and pixels per row of either
+uint32_t* _color_target = nullptr;
+size_t _color_pitch = 0;
+std::vector<uint32_t> _background;
+std::vector<float> _depth_buffer;
+int _hiz_blocks_x = 0;
+int _hiz_blocks_y = 0;
+std::vector<float> _hiz;
+std::vector<uint8_t> _hiz_dirty;
+bool _hiz_enabled = true;
+
+};
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace simplegl
+{
+
+// Bounded hand-off of frames from one producer thread to one consumer
+// thread. The Slots frames are created once and passed around in a ring, so
+// whatever storage a frame grew to is reused by the frames after it; the
+// producer blocks while every slot waits to be consumed.
+//
+// Producer: acquireWrite(), fill the frame, publish(). Consumer:
+// acquireRead(), use the frame, release(). After close() the acquire calls
+// return nullptr, the consumer's once the published frames are drained.
+template <typename Frame, size_t Slots = 2>
+class FramePipeline {
+
+    static_assert(Slots > 0);
+
+public:
+
+    Frame * acquireWrite() {
+        std::unique_lock lock(_mutex);
+        _condition.wait(lock, [this]{ return _closed || _filled < Slots; });
+        return _closed ? nullptr : &_frames[_write];
+    }
+
+    // Like acquireWrite() but nullptr instead of waiting for a free slot.
+    Frame * tryAcquireWrite() {
+        std::lock_guard lock(_mutex);
+        return _closed || _filled == Slots ? nullptr : &_frames[_write];
+    }
+
+    void publish() {
+        {
+            std::lock_guard lock(_mutex);
+            _write = (_write + 1) % Slots;
+            ++_filled;
+        }
+        _condition.notify_all();
+    }
+
+    Frame * acquireRead() {
+        std::unique_lock lock(_mutex);
+        _condition.wait(lock, [this]{ return _closed || _filled > 0; });
+        return _filled > 0 ? &_frames[_read] : nullptr;
+    }
+
+    // Like acquireRead() but nullptr instead of waiting for a frame.
+    Frame * tryAcquireRead() {
+        std::lock_guard lock(_mutex);
+        return _filled > 0 ? &_frames[_read] : nullptr;
+    }
+
+    void release() {
+        {
+            std::lock_guard lock(_mutex);
+            _read = (_read + 1) % Slots;
+            --_filled;
+        }
+        _condition.notify_all();
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(_mutex);
+            _closed = true;
+        }
+        _condition.notify_all();
+    }
+
+private:
+
+    std::array<Frame, Slots> _frames;
+    size_t _write = 0;
+    size_t _read = 0;
+    size_t _filled = 0;
+    bool _closed = false;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+
+};
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <span>
+#include <vector>
+
+namespace simplegl
+{
+
+// Frames the rolling frame time statistics cover, ten seconds at 60 Hz.
+constexpr size_t kFrameTimeWindow = 600;
+
+struct FrameTimeStats {
+    size_t frames = 0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+};
+
+// Nearest rank percentiles of frame times in milliseconds.
+FrameTimeStats frameTimeStats(std::span<double const> frameTimesMs);
+
+// Paces the window loop on the monotonic clock. Frame deadlines are spaced
+// exactly 1/targetFps apart from the first frame on, so rounding never
+// accumulates; a frame running late moves the following deadlines instead of
+// letting later frames catch up in a burst.
+class FrameScheduler {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    // A targetFps of 0 does not wait at all, for when presenting waits for
+    // vsync or to run unthrottled.
+    explicit FrameScheduler(double targetFps);
+
+    void setTargetFps(double targetFps);
+
+    double targetFps() const {
+        return _target_fps;
+    }
+
+    // Waits for the next deadline, sleeping while it is far and spinning for
+    // the last stretch the OS sleep is too coarse for. Records the time since
+    // the previous call returned as the frame time, both up to this call (the
+    // frame's work) and up to its return (the paced interval).
+    void waitNextFrame();
+
+    // Restarts the pacing after the loop sat idle without frames: the next
+    // deadline is one period from now and the idle time is not recorded.
+    void resume();
+
+    // Paced frame intervals over the last kFrameTimeWindow frames, close to
+    // the target period whenever the work fits in it
+    FrameTimeStats stats() const;
+
+    // Work per frame, without the wait, over the same frames
+    FrameTimeStats workStats() const;
+
+private:
+
+    double _target_fps = 0.0;
+    Clock::duration _period{};
+    Clock::time_point _deadline;
+    Clock::time_point _frame_start;
+    bool _started = false;
+
+    // Ring buffers of the last kFrameTimeWindow frame intervals and work
+    // times, written at the same index
+    std::vector<double> _frame_times_ms;
+    std::vector<double> _work_times_ms;
+    size_t _next_frame_time = 0;
+
+};
+
+}
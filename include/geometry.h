@@ -0,0 +1,63 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "vec.h"
+
+namespace simplegl
+{
+
+// Positions stored as structure of arrays, one array per coordinate, so the
+// transform works on whole vector registers of x, of y and of z.
+struct PositionArrays {
+    std::vector<scalar_t> x;
+    std::vector<scalar_t> y;
+    std::vector<scalar_t> z;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+};
+
+// Homogeneous clip space positions, before the perspective divide.
+struct ClipPositionArrays {
+    std::vector<scalar_t> x;
+    std::vector<scalar_t> y;
+    std::vector<scalar_t> z;
+    std::vector<scalar_t> w;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        w.resize(count);
+    }
+
+    vec4_t at(size_t index) const {
+        return vec4_t{x[index], y[index], z[index], w[index]};
+    }
+};
+
+PositionArrays toPositionArrays(std::span<vec3_t const> positions);
+
+// transformed[i] = matrix*(positions[i], 1), every position exactly once.
+// transformed is resized to match. Vectorized for the SIMD level of the
+// active span kernels, with results bit-identical to the scalar loop.
+void transformPositions(mat4_t const & matrix, PositionArrays const & positions, ClipPositionArrays & transformed);
+
+// The same for positions [first, first + count) only, written at the same
+// indexes. transformed must hold at least first + count elements.
+void transformPositions(mat4_t const & matrix, PositionArrays const & positions, size_t first, size_t count, ClipPositionArrays & transformed);
+
+}
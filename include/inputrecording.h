@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rasterizer.h"
+
+namespace simplegl
+{
+
+// What a key press does to the view, independent of SDL.
+enum class InputAction {
+    RotateXUp,
+    RotateXDown,
+    RotateYLeft,
+    RotateYRight,
+    ZoomIn,
+    ZoomOut,
+    ToggleDepthTest,
+    ToggleFillMode
+};
+
+std::string_view toString(InputAction action);
+
+std::optional<InputAction> inputActionFromString(std::string_view name);
+
+struct InputEvent {
+    // Window loop iteration the action was applied in, from 0
+    uint32_t frame = 0;
+    InputAction action = InputAction::RotateXUp;
+};
+
+// Everything besides the input that decides what a session draws. Meshes
+// are loaded through the path as given, so a replay must run from the same
+// working directory as its recording.
+struct SessionOptions {
+    std::string meshPath;
+    FillMode fillMode = FillMode::EdgeFunction;
+    bool depthTest = true;
+    bool weld = false;
+    bool lod = true;
+    bool meshlets = true;
+    bool edgeWireframe = true;
+};
+
+// A window session: the options it started with and every input action, in
+// order.
+struct InputRecording {
+    SessionOptions options;
+    std::vector<InputEvent> events;
+    uint32_t frames = 0;
+};
+
+// Writes a session as text, one action per line, flushed at every frame
+// with input so a session that crashes is still recorded up to its last
+// input:
+//
+//     simplegl-input 1
+//     mesh ../objects/teapot.obj
+//     fill edge
+//     depth on
+//     weld off
+//     lod on
+//     meshlets on
+//     wireframe edges
+//     12 rotate-x-up
+//     frames 345
+class InputRecorder {
+
+public:
+
+    static std::optional<InputRecorder> Create(std::string const & path, SessionOptions const & options);
+
+    void record(uint32_t frame, InputAction action);
+
+    // Ends the session after frames window loop iterations.
+    void finish(uint32_t frames);
+
+private:
+
+    InputRecorder() = default;
+
+    std::ofstream _file;
+    uint32_t _last_frame = UINT32_MAX;
+
+};
+
+// Reads a file written by InputRecorder. Options the file leaves out keep
+// their value from defaults, and a session without its final frames line
+// ends one frame after its last action.
+std::optional<InputRecording> loadInputRecording(std::string const & path, SessionOptions const & defaults);
+
+}
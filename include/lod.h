@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh.h"
+
+namespace simplegl
+{
+
+// Every LOD level keeps this fraction of the faces of the previous one.
+constexpr double kLodRatio = 0.5;
+
+// Meshes this small are not simplified further.
+constexpr size_t kMinLodFaces = 256;
+
+// Simplified levels a LodChain builds at most.
+constexpr unsigned kMaxLodLevels = 12;
+
+// Projected pixels each front facing triangle should cover at least.
+constexpr double kLodPixelsPerTriangle = 4.0;
+
+// Quadric error metric edge collapse (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics") down to about targetFaces.
+// Collapses that would flip a face or pinch the surface are skipped, so
+// the result can stay above the target. Only positions are simplified:
+// faces of the result have no texture UV or normal indexes.
+Mesh simplifyMesh(Mesh const & mesh, size_t targetFaces);
+
+// A mesh and simplified versions of it, finest first. Every simplified
+// level is built from the previous one with kLodRatio of its faces and is
+// optimized for the vertex cache.
+class LodChain {
+
+public:
+
+    // Stops early at kMinLodFaces or when simplification stalls.
+    explicit LodChain(Mesh mesh, unsigned simplifiedLevels = kMaxLodLevels);
+
+    size_t levelCount() const {
+        return _levels.size();
+    }
+
+    Mesh const & level(size_t index) const {
+        return _levels[index];
+    }
+
+    // Radius of the sphere around the model origin holding every vertex.
+    double boundingRadius() const {
+        return _bounding_radius;
+    }
+
+    // Finest level whose front facing half spreads over projectedArea pixels
+    // with at least kLodPixelsPerTriangle pixels per triangle, the coarsest
+    // level when none does.
+    size_t select(double projectedArea) const;
+
+private:
+
+    std::vector<Mesh> _levels;
+    double _bounding_radius = 0.0;
+
+};
+
+}
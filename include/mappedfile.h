@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace simplegl
+{
+
+// Read-only view of a whole file. Memory mapped where the platform supports
+// it, so the bytes are scanned in place; read into memory otherwise (and for
+// files that cannot be mapped, like pipes or empty files).
+class MappedFile {
+
+public:
+
+    static std::optional<MappedFile> open(std::string_view path);
+
+    std::string_view contents() const {
+        return _mapped ? std::string_view{_data, _size} : std::string_view{_buffer};
+    }
+
+    bool isMapped() const {
+        return _mapped;
+    }
+
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile& operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile && other);
+    MappedFile& operator=(MappedFile && other);
+
+private:
+
+    MappedFile() = default;
+
+    void unmap();
+
+    char const * _data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;
+    std::string _buffer;
+
+};
+
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <memory>
+#include <span>
 #include <vector>
 
 #include "triangle.h"
@@ -21,30 +23,54 @@ struct Face {
     std::array<VertexIndex,3> indexes = {};
 };
 
+// Values closer than this on every axis are merged by Mesh::weld
+constexpr double kWeldTolerance = 1e-5;
+
+struct WeldStats {
+    size_t vertexesBefore = 0;
+    size_t vertexesAfter = 0;
+    size_t textureUVsBefore = 0;
+    size_t textureUVsAfter = 0;
+    size_t normalsBefore = 0;
+    size_t normalsAfter = 0;
+};
+
 class Mesh {
 
 public:
 
+    Mesh() = default;
+
+    Mesh(std::vector<vec3_t> vertexes, std::vector<vec2_t> textureUVs, std::vector<vec3_t> normals, std::vector<Face> faces);
+
     static Mesh buildSphere(unsigned int geometryLevel);
 
     static Mesh buildCylinder(unsigned int geometryLevel);
 
-    std::vector<vec3_t> const & vertices() const {
-        return _vertexes;
+    // Views stay valid until the mesh is modified or destroyed.
+    std::span<vec3_t const> vertices() const {
+        return _external ? _external->vertexes : std::span<vec3_t const>{_vertexes};
     }
     
-    std::vector<vec2_t> const & textureUVs() const {
-        return _textureUVs;
+    std::span<vec2_t const> textureUVs() const {
+        return _external ? _external->textureUVs : std::span<vec2_t const>{_textureUVs};
     }
     
-    std::vector<vec3_t> const & normals() const {
-        return _normals;
+    std::span<vec3_t const> normals() const {
+        return _external ? _external->normals : std::span<vec3_t const>{_normals};
     }
     
-    std::vector<Face> const & faces() const {
-        return _faces;
+    std::span<Face const> faces() const {
+        return _external ? _external->faces : std::span<Face const>{_faces};
     }
-    
+
+    // Mesh over arrays it does not own, like a memory mapped file, kept
+    // alive by owner. Nothing is copied until the mesh is modified.
+    static Mesh view(std::shared_ptr<void const> owner, std::span<vec3_t const> vertexes, std::span<vec2_t const> textureUVs, std::span<vec3_t const> normals, std::span<Face const> faces);
+
+    // Capacity for the given element counts, so adding them never reallocates.
+    void reserve(size_t vertices, size_t textureUVs, size_t normals, size_t faces);
+
     void addVertex(vec3_t const & vertex);
 
     void addTextureUV(vec2_t const & textureUV);
@@ -55,11 +81,34 @@ public:
 
     void addSimpleTriangle(vec3_t v1, vec3_t v2, vec3_t v3);
 
+    // Appends the elements as they are, face indexes must already refer to
+    // the combined arrays.
+    void append(std::span<vec3_t const> vertexes, std::span<vec2_t const> textureUVs, std::span<vec3_t const> normals, std::span<Face const> faces);
+
+    // Merges duplicated positions, texture UVs and normals and rewrites the
+    // face indexes to the merged arrays, keeping first-use order. Values are
+    // hashed after snapping to a tolerance sized grid, so near duplicates
+    // that straddle a grid line stay apart. Unused values are dropped too.
+    WeldStats weld(double tolerance = kWeldTolerance);
+
 private:
+
+    // Copies external arrays into the owned ones before a modification
+    void detach();
+
+    struct External {
+        std::shared_ptr<void const> owner;
+        std::span<vec3_t const> vertexes;
+        std::span<vec2_t const> textureUVs;
+        std::span<vec3_t const> normals;
+        std::span<Face const> faces;
+    };
+
     std::vector<vec3_t> _vertexes;
     std::vector<vec2_t> _textureUVs;
     std::vector<vec3_t> _normals;
     std::vector<Face> _faces;
+    std::shared_ptr<External const> _external;
 
 };
 
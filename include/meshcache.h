@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "mesh.h"
+
+namespace simplegl
+{
+
+// Binary mesh file mirroring Mesh's arrays, loaded by mapping it and handing
+// the Mesh views into the mapping. Native byte order and scalar_t, it is a
+// local cache of an OBJ, not an interchange format: a file written by another
+// build or version is rejected and rebuilt.
+//
+// Layout: MeshCacheHeader, then the vertex, texture UV, normal and face
+// arrays, each starting at a multiple of kMeshCacheAlignment.
+class MeshCache {
+
+public:
+
+    static constexpr uint32_t kVersion = 2;
+    static constexpr size_t kMeshCacheAlignment = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        // Detects caches from another byte order or scalar_t
+        uint32_t byteOrderMark;
+        uint32_t scalarSize;
+        uint32_t reserved;
+        uint64_t vertexCount;
+        uint64_t textureUVCount;
+        uint64_t normalCount;
+        uint64_t faceCount;
+        double boundsMin[3];
+        double boundsMax[3];
+    };
+
+    // Where the cache of the OBJ at objPath lives, next to it.
+    static std::string pathFor(std::string_view objPath);
+
+    static bool save(Mesh const & mesh, std::string_view path);
+
+    static std::optional<Mesh> load(std::string_view path);
+
+};
+
+}
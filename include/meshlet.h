@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "clipping.h"
+#include "geometry.h"
+#include "mesh.h"
+#include "vec.h"
+
+namespace simplegl
+{
+
+// Meshlet limits, small enough that local vertex indexes fit a byte and the
+// transformed vertexes of a meshlet stay in L1.
+constexpr size_t kMeshletMaxVertexes = 64;
+constexpr size_t kMeshletMaxTriangles = 124;
+
+// A cluster of neighboring faces with everything needed to cull it whole.
+struct Meshlet {
+    // Range of MeshletMesh::vertexes
+    uint32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+    // Range of MeshletMesh::triangles, in triangles
+    uint32_t triangleOffset = 0;
+    uint32_t triangleCount = 0;
+    // The positions this meshlet uses first, which no earlier meshlet uses
+    uint32_t firstOwnedVertex = 0;
+    uint32_t ownedVertexCount = 0;
+
+    // Bounding sphere
+    vec3d_t center;
+    double radius = 0.0;
+
+    // Normal cone: every face normal is within asin(coneSine) of the unit
+    // coneAxis. coneSine is above 1 when the normals spread too much to
+    // ever cull the meshlet as back facing.
+    vec3d_t coneAxis;
+    double coneSine = 2.0;
+};
+
+struct MeshletMesh {
+    std::vector<Meshlet> meshlets;
+    // Mesh vertexes in the order meshlets first use them, so the vertexes
+    // owned by a meshlet are contiguous. Vertexes no face uses are dropped.
+    PositionArrays positions;
+    // Meshlet owning each position
+    std::vector<uint32_t> owners;
+    // Indexes into positions of the vertexes of each meshlet
+    std::vector<uint32_t> vertexes;
+    // Three vertexes per triangle, indexes into the vertexes of its meshlet
+    std::vector<uint8_t> triangles;
+};
+
+// Grows meshlets over neighboring faces, preferring faces that add no new
+// vertex and then faces facing the way the meshlet already does, so the
+// normal cones stay narrow. Faces with a vertex index out of range are left
+// out.
+MeshletMesh buildMeshlets(Mesh const & mesh);
+
+// Meshlet tests of one frame, in model space.
+class MeshletCuller {
+
+public:
+
+    // eye is the camera position in model space.
+    MeshletCuller(ClipVolume const & volume, mat4d_t const & modelToClip, vec3d_t const & eye);
+
+    // False when the meshlet is entirely outside the volume or every face of
+    // it is back facing, with the convention of the culling in update():
+    // dot(cross(b - a, c - a), a - eye) > 0.
+    bool visible(Meshlet const & meshlet) const;
+
+private:
+
+    FrustumPlanes _planes;
+    vec3d_t _eye;
+
+};
+
+}
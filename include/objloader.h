@@ -12,7 +12,15 @@ class ObjLoader {
 
 public:
 
-    static std::optional<Mesh> load(std::string_view path);
+    // With threadCount > 1 the file is split into line-aligned chunks that
+    // are parsed in parallel and merged in file order; the Mesh is the same
+    // as the one a single thread loads.
+    static std::optional<Mesh> load(std::string_view path, unsigned threadCount = 1);
+
+    // load() followed by optimizeVertexCache(), through the MeshCache file
+    // next to the OBJ: the cache is mapped when it is newer than the OBJ, and
+    // (re)written otherwise, so the optimization only runs on a cache miss.
+    static std::optional<Mesh> loadCached(std::string_view path, unsigned threadCount = 1);
 
 };
 
@@ -0,0 +1,128 @@
+#pragma once
+
+// Instrumentation zones and counters, exported as a Chrome trace (load the
+// file in chrome://tracing or https://ui.perfetto.dev).
+//
+//     SIMPLEGL_ZONE("update");            // times the enclosing scope
+//     SIMPLEGL_COUNTER("triangles", n);   // samples a value
+//
+// Without SIMPLEGL_PROFILE both macros expand to nothing and none of the
+// code below is compiled. With it, a zone costs one relaxed load while
+// recording is off, and two clock reads and a store into the thread's own
+// ring buffer while it is on.
+
+#ifdef SIMPLEGL_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define SIMPLEGL_PROFILE_CONCAT_(a, b) a##b
+#define SIMPLEGL_PROFILE_CONCAT(a, b) SIMPLEGL_PROFILE_CONCAT_(a, b)
+#define SIMPLEGL_ZONE(name) ::simplegl::profile::Zone SIMPLEGL_PROFILE_CONCAT(simplegl_zone_, __LINE__)(name)
+#define SIMPLEGL_COUNTER(name, value) ::simplegl::profile::counter(name, value)
+
+namespace simplegl::profile
+{
+
+// Events kept per thread, the oldest are overwritten. 2 MB per thread.
+constexpr size_t kEventsPerThread = size_t{1} << 16;
+
+enum class EventType : uint8_t {
+    Zone,
+    Counter
+};
+
+// name must outlive the export, in practice a string literal.
+struct Event {
+    char const * name = nullptr;
+    int64_t start = 0;
+    // End time of a zone, value of a counter
+    int64_t value = 0;
+    EventType type = EventType::Zone;
+};
+
+// Single writer ring: only the owning thread appends, written is published
+// with release so the exporter sees whole events.
+struct ThreadBuffer {
+    std::vector<Event> events;
+    std::atomic<uint64_t> written{0};
+    uint32_t id = 0;
+    std::string name;
+};
+
+extern std::atomic<bool> gRecording;
+
+inline thread_local ThreadBuffer * tThreadBuffer = nullptr;
+
+// Creates and registers the calling thread's buffer.
+ThreadBuffer & registerThread();
+
+inline bool recording() {
+    return gRecording.load(std::memory_order_relaxed);
+}
+
+// Nanoseconds on the monotonic clock
+inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void record(Event const & event) {
+    ThreadBuffer & buffer = tThreadBuffer ? *tThreadBuffer : registerThread();
+    const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+    buffer.events[index & (kEventsPerThread - 1)] = event;
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+inline void counter(char const * name, int64_t value) {
+    if (recording()) {
+        record({name, now(), value, EventType::Counter});
+    }
+}
+
+class Zone {
+
+public:
+
+    explicit Zone(char const * name) :
+    _name{name},
+    _start{recording() ? now() : -1} {
+    }
+
+    ~Zone() {
+        if (_start >= 0) {
+            record({_name, _start, now(), EventType::Zone});
+        }
+    }
+
+    Zone(Zone const &) = delete;
+    Zone& operator=(Zone const &) = delete;
+
+private:
+
+    char const * _name;
+    int64_t _start;
+
+};
+
+void setRecording(bool recording);
+
+// Names the calling thread in the trace.
+void setThreadName(std::string_view name);
+
+// Writes the events recorded so far as Chrome trace JSON. Call it while no
+// thread is recording, events being overwritten are not locked out. Returns
+// false when the file cannot be written.
+bool writeChromeTrace(std::string const & path);
+
+}
+
+#else
+
+#define SIMPLEGL_ZONE(name) ((void)0)
+#define SIMPLEGL_COUNTER(name, value) ((void)0)
+
+#endif
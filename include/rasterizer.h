@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+#include "framebuffer.h"
+#include "vec.h"
+
+namespace simplegl
+{
+
+enum class FillMode {
+    Scanline,       // Framebuffer::fillTriangle, flat top / flat bottom split
+    EdgeFunction    // simplegl::fillTriangle, half-space edge functions
+};
+
+// Vertices are snapped to 1/16th of a pixel before rasterization.
+constexpr int kSubPixelBits = 4;
+constexpr int kSubPixelScale = 1 << kSubPixelBits;
+
+// Largest vertex coordinate (in pixels) the fixed point setup can hold without
+// overflowing the 64 bit edge functions.
+constexpr double kMaxRasterCoordinate = 16384.0;
+
+// Fills the triangle abc with the edge function rasterizer, touching only
+// pixels inside clip. Pixels are sampled at their centers and shared edges
+// follow the top-left rule, so meshes are drawn without cracks or overdraw.
+// Returns false, without drawing, when a vertex exceeds kMaxRasterCoordinate.
+bool fillTriangle(Framebuffer & framebuffer, vec2_t const & a, vec2_t const & b, vec2_t const & c, uint32_t color, Rect const & clip);
+
+bool fillTriangle(Framebuffer & framebuffer, vec2_t const & a, vec2_t const & b, vec2_t const & c, uint32_t color);
+
+// Work done by the rasterizer, all but pixelsFilled by the depth tested path
+// only. When drawing tiles a triangle is counted once for every tile it
+// overlaps.
+struct RasterStats {
+    uint64_t triangles = 0;
+    uint64_t trianglesRejected = 0;  // fully behind the hierarchical Z buffer
+    uint64_t blocksRejected = 0;     // bounding box blocks skipped by hierarchical Z
+    uint64_t pixelsTested = 0;       // reached the per pixel depth test
+    uint64_t pixelsWritten = 0;      // passed it
+    uint64_t pixelsFilled = 0;       // written by the paths without a depth test
+
+    RasterStats& operator+=(RasterStats const & other);
+};
+
+// Depth tested fill, z of each vertex is its inverse view depth. Triangles
+// and kHiZBlockSize^2 blocks that are behind the hierarchical Z buffer are
+// skipped before any per pixel work; the rest is depth tested per pixel
+// before writing (early Z).
+bool fillTriangle(Framebuffer & framebuffer, vec3_t const & a, vec3_t const & b, vec3_t const & c, uint32_t color, Rect const & clip, RasterStats & stats);
+
+// Fills abc inside clip with the given path. EdgeFunction falls back to the
+// scanline path, which has no depth test, for triangles it cannot represent.
+// Pixels written without a depth test go to stats.pixelsFilled.
+void fillTriangle(Framebuffer & framebuffer, vec3_t const & a, vec3_t const & b, vec3_t const & c, uint32_t color, Rect const & clip, FillMode fillMode, bool depthTest, RasterStats & stats);
+
+}
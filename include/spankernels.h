@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace simplegl
+{
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// Writes color to dst[0, count).
+using FillSpanKernel = void (*)(uint32_t* dst, int count, uint32_t color);
+
+// Depth tested span write. Pixel i gets the depth z0 + i*dz (inverse depth,
+// larger is closer) and is written to both buffers when it is closer than the
+// stored depth. Returns the number of pixels written.
+using DepthSpanKernel = int (*)(uint32_t* color, float* depth, int count, float z0, float dz, uint32_t fill);
+
+// Every level produces bit-identical results, the scalar one is the reference.
+struct SpanKernels {
+    SimdLevel level;
+    FillSpanKernel fillSpan;
+    DepthSpanKernel depthSpan;
+};
+
+// Highest level the running CPU supports.
+SimdLevel detectSimdLevel();
+
+// Kernels used by the rasterizer. Defaults to detectSimdLevel().
+SpanKernels const & spanKernels();
+
+// Switches the rasterizer to the given level. Returns false, leaving the
+// current kernels in place, when the CPU does not support it. Not thread
+// safe, call it between frames.
+bool selectSpanKernels(SimdLevel level);
+
+std::string_view toString(SimdLevel level);
+
+std::optional<SimdLevel> simdLevelFromString(std::string_view name);
+
+}
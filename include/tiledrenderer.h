@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+#include "rasterizer.h"
+#include "vec.h"
+
+namespace simplegl
+{
+
+constexpr int kTileSize = 64;
+
+// Triangles to draw in one frame, three consecutive vertexes per triangle.
+// Vertexes are in pixels with the inverse view depth in z.
+struct RenderJob {
+    std::vector<vec3_t> const * vertexes = nullptr;
+    // Wireframe edges to draw per triangle, all of them when null
+    std::vector<uint8_t> const * edgeMasks = nullptr;
+    // Wireframe drawn as separate lines instead, two vertexes per line
+    std::vector<vec3_t> const * lines = nullptr;
+    FillMode fillMode = FillMode::EdgeFunction;
+    bool depthTest = true;
+    // Every tile restores its part of the framebuffer background first
+    bool restoreBackground = false;
+    uint32_t fillColor = 0;
+    uint32_t wireColor = 0;
+};
+
+// Sorts the triangles of a frame into kTileSize x kTileSize screen tiles and
+// rasterizes the tiles in parallel. Every tile is drawn by exactly one thread,
+// clipped to its own rectangle, so the framebuffer needs no locking. Inside a
+// tile all fills are drawn first and then all wireframes, both in submission
+// order, which gives the same image as drawing the whole frame serially.
+class TiledRenderer {
+
+public:
+
+    // threadCount includes the calling thread, which works on tiles too.
+    TiledRenderer(int width, int height, unsigned threadCount);
+
+    ~TiledRenderer();
+
+    TiledRenderer(TiledRenderer const &) = delete;
+    TiledRenderer& operator=(TiledRenderer const &) = delete;
+
+    void render(Framebuffer & framebuffer, RenderJob const & job);
+
+    unsigned threadCount() const {
+        return static_cast<unsigned>(_workers.size()) + 1;
+    }
+
+    // Rasterizer counters of the last render(), summed over all threads.
+    RasterStats stats() const;
+
+private:
+
+    void bin(std::vector<vec3_t> const & vertexes);
+
+    void binLines(std::vector<vec3_t> const & lines);
+
+    void renderTiles(unsigned thread);
+
+    void renderTile(int tileIndex, RasterStats & stats);
+
+    void workerLoop(unsigned thread);
+
+    int _tiles_x = 0;
+    int _tiles_y = 0;
+    int _width = 0;
+    int _height = 0;
+
+    // Triangle indexes overlapping each tile, in submission order. Cleared
+    // every frame but never shrunk, so binning stops allocating after warm-up.
+    std::vector<std::vector<uint32_t>> _bins;
+    // Same for the lines of the job, if any
+    std::vector<std::vector<uint32_t>> _line_bins;
+
+    Framebuffer* _framebuffer = nullptr;
+    RenderJob _job;
+
+    // One slot per thread, the calling thread uses slot 0
+    struct alignas(64) ThreadStats {
+        RasterStats stats;
+    };
+    std::vector<ThreadStats> _stats;
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _frame_started;
+    std::condition_variable _frame_finished;
+    uint64_t _frame = 0;
+    unsigned _busy_workers = 0;
+    bool _stop = false;
+    std::atomic<int> _next_tile{0};
+
+};
+
+}
@@ -1,182 +1,368 @@
 #pragma once
 
 #include <cmath>
+#include <optional>
+#include <type_traits>
 
 namespace simplegl
 {
 
-struct vec2_t;
-double length(vec2_t const & vec);
+// Scalar type of the pipeline: mesh vertexes, transforms and the screen space
+// vertexes handed to the rasterizer. Built with SIMPLEGL_SCALAR_FLOAT it is
+// float, twice the SIMD lanes and half the memory traffic of double. Code
+// that needs the precision names double explicitly.
+#ifdef SIMPLEGL_SCALAR_FLOAT
+using scalar_t = float;
+#else
+using scalar_t = double;
+#endif
 
-struct vec2_t {
-    double x = 0;
-    double y = 0;
+template <typename T, int N>
+struct vec;
 
-    vec2_t& normalize() {
-        const double len = length(*this);
-        x /= len;
-        y /= len;
-        return *this;
+template <typename T>
+struct vec<T, 2> {
+    T x = 0;
+    T y = 0;
+
+    constexpr T & operator[](int i) {
+        return i == 0 ? x : y;
+    }
+
+    constexpr T const & operator[](int i) const {
+        return i == 0 ? x : y;
+    }
+
+    vec & normalize();
+};
+
+template <typename T>
+struct vec<T, 3> {
+    T x = 0;
+    T y = 0;
+    T z = 0;
+
+    constexpr T & operator[](int i) {
+        return i == 0 ? x : i == 1 ? y : z;
+    }
+
+    constexpr T const & operator[](int i) const {
+        return i == 0 ? x : i == 1 ? y : z;
+    }
+
+    vec & normalize();
+
+    constexpr vec<T, 2> xy() const {
+        return vec<T, 2> {
+            x,
+            y
+        };
+    }
+};
+
+template <typename T>
+struct vec<T, 4> {
+    T x = 0;
+    T y = 0;
+    T z = 0;
+    T w = 0;
+
+    constexpr T & operator[](int i) {
+        return i == 0 ? x : i == 1 ? y : i == 2 ? z : w;
+    }
+
+    constexpr T const & operator[](int i) const {
+        return i == 0 ? x : i == 1 ? y : i == 2 ? z : w;
     }
+
+    vec & normalize();
 };
 
-inline double length(vec2_t const & vec) {
-    return std::sqrt(
-            vec.x*vec.x +
-            vec.y*vec.y
-        );
+using vec2_t = vec<scalar_t, 2>;
+using vec3_t = vec<scalar_t, 3>;
+using vec4_t = vec<scalar_t, 4>;
+using point3_t = vec3_t;
+
+using vec2d_t = vec<double, 2>;
+using vec3d_t = vec<double, 3>;
+using vec4d_t = vec<double, 4>;
+
+// Scalars combined with a vec take its precision, so a double literal does
+// not prevent deduction for float vectors.
+template <typename T>
+using scalar_of_t = std::type_identity_t<T>;
+
+template <typename U, typename T, int N>
+constexpr vec<U, N> vecCast(vec<T, N> const & vec) {
+    simplegl::vec<U, N> result;
+    for (int i = 0; i < N; ++i) result[i] = static_cast<U>(vec[i]);
+    return result;
 }
 
-inline vec2_t operator*(vec2_t const & vec, double scalar) {
-    return vec2_t{
-        vec.x * scalar,
-        vec.y * scalar
-    };
+template <typename T, int N>
+constexpr vec<T, N> operator*(vec<T, N> const & vec, scalar_of_t<T> scalar) {
+    simplegl::vec<T, N> result;
+    for (int i = 0; i < N; ++i) result[i] = vec[i] * scalar;
+    return result;
 }
 
-inline vec2_t operator*(double scalar, vec2_t const & vec) {
+template <typename T, int N>
+constexpr vec<T, N> operator*(scalar_of_t<T> scalar, vec<T, N> const & vec) {
     return vec * scalar;
 }
 
-inline vec2_t operator/(double scalar, vec2_t const & vec) {
-    return vec2_t{
-        vec.x / scalar,
-        vec.y / scalar
-    };
+template <typename T, int N>
+constexpr vec<T, N> operator/(vec<T, N> const & vec, scalar_of_t<T> scalar) {
+    simplegl::vec<T, N> result;
+    for (int i = 0; i < N; ++i) result[i] = vec[i] / scalar;
+    return result;
 }
 
-inline vec2_t operator+(vec2_t const & a, vec2_t const & b) {
-    return vec2_t{
-        a.x + b.x,
-        a.y + b.y
-    };
+template <typename T, int N>
+constexpr vec<T, N> operator+(vec<T, N> const & a, vec<T, N> const & b) {
+    vec<T, N> result;
+    for (int i = 0; i < N; ++i) result[i] = a[i] + b[i];
+    return result;
 }
 
-inline vec2_t operator-(vec2_t const & a, vec2_t const & b) {
-    return vec2_t{
-        a.x - b.x,
-        a.y - b.y
-    };
+template <typename T, int N>
+constexpr vec<T, N> operator-(vec<T, N> const & a, vec<T, N> const & b) {
+    vec<T, N> result;
+    for (int i = 0; i < N; ++i) result[i] = a[i] - b[i];
+    return result;
 }
 
-inline vec2_t operator-(vec2_t const & vec) {
-    return vec2_t{
-        -vec.x,
-        -vec.y
-    };
+template <typename T, int N>
+constexpr vec<T, N> operator-(vec<T, N> const & vec) {
+    simplegl::vec<T, N> result;
+    for (int i = 0; i < N; ++i) result[i] = -vec[i];
+    return result;
 }
 
-inline vec2_t normalize(vec2_t const & vec) {
-    vec2_t normal = vec;
-    return normal.normalize();
+template <typename T, int N>
+constexpr T dot(vec<T, N> const & a, vec<T, N> const & b) {
+    T result = a[0] * b[0];
+    for (int i = 1; i < N; ++i) result += a[i] * b[i];
+    return result;
 }
 
-inline double dot(vec2_t const & a, vec2_t const & b) {
-    return  (a.x * b.x) +
-            (a.y * b.y);
+template <typename T>
+constexpr vec<T, 3> cross(vec<T, 3> const & a, vec<T, 3> const & b) {
+    return vec<T, 3>{
+        (a.y * b.z) - (a.z * b.y),
+        (a.z * b.x) - (a.x * b.z),
+        (a.x * b.y) - (a.y * b.x)
+    };
 }
 
-struct vec3_t;
-double length(vec3_t const & vec);
-
-struct vec3_t {
-    double x = 0.0;
-    double y = 0.0;
-    double z = 0.0;
+// Not constexpr, std::sqrt is not until C++26.
+template <typename T, int N>
+T length(vec<T, N> const & vec) {
+    return std::sqrt(dot(vec, vec));
+}
 
-    vec3_t & normalize() {
-        const double len = length(*this);
-        x /= len;
-        y /= len;
-        z /= len;
-        return *this;
-    }
+template <typename T, int N>
+vec<T, N> normalize(vec<T, N> const & vec) {
+    return vec / length(vec);
+}
 
-    vec2_t xy() {
-        return vec2_t {
-            x,
-            y
-        };
-    }
-};
+template <typename T>
+vec<T, 2> & vec<T, 2>::normalize() {
+    return *this = simplegl::normalize(*this);
+}
 
-using point3_t = vec3_t;
+template <typename T>
+vec<T, 3> & vec<T, 3>::normalize() {
+    return *this = simplegl::normalize(*this);
+}
 
-inline double length(vec3_t const & vec) {
-    return std::sqrt(
-            vec.x*vec.x +
-            vec.y*vec.y +
-            vec.z*vec.z
-        );
+template <typename T>
+vec<T, 4> & vec<T, 4>::normalize() {
+    return *this = simplegl::normalize(*this);
 }
 
 struct camera_t {
     point3_t position;
     vec3_t rotation;
-    double pov;
+    scalar_t pov;
 };
 
-inline vec3_t operator*(vec3_t const & vec, double scalar) {
-    return vec3_t{
-        vec.x * scalar,
-        vec.y * scalar,
-        vec.z * scalar
-    };
-}
+// Row-major matrix acting on column vectors, p' = m*p, so a*b applies b
+// first. View space looks down +z with y up, like the rest of the pipeline.
+template <typename T>
+struct mat4 {
+    T m[4][4] = {};
 
-inline vec3_t operator*(double scalar, vec3_t const & vec) {
-    return vec * scalar;
-}
+    static constexpr mat4 identity() {
+        mat4 result;
+        for (int i = 0; i < 4; ++i) result.m[i][i] = 1;
+        return result;
+    }
 
-inline vec3_t operator/(double scalar, vec3_t const & vec) {
-    return vec3_t{
-        vec.x / scalar,
-        vec.y / scalar,
-        vec.z / scalar
-    };
-}
+    static constexpr mat4 translation(vec<T, 3> const & offset) {
+        mat4 result = identity();
+        result.m[0][3] = offset.x;
+        result.m[1][3] = offset.y;
+        result.m[2][3] = offset.z;
+        return result;
+    }
 
-inline vec3_t operator+(vec3_t const & a, vec3_t const & b) {
-    return vec3_t{
-        a.x + b.x,
-        a.y + b.y,
-        a.z + b.z
-    };
+    static constexpr mat4 scale(T factor) {
+        mat4 result = identity();
+        result.m[0][0] = factor;
+        result.m[1][1] = factor;
+        result.m[2][2] = factor;
+        return result;
+    }
+
+    static mat4 rotationX(T angle) {
+        mat4 result = identity();
+        result.m[1][1] = std::cos(angle);
+        result.m[1][2] = -std::sin(angle);
+        result.m[2][1] = std::sin(angle);
+        result.m[2][2] = std::cos(angle);
+        return result;
+    }
+
+    static mat4 rotationY(T angle) {
+        mat4 result = identity();
+        result.m[0][0] = std::cos(angle);
+        result.m[0][2] = std::sin(angle);
+        result.m[2][0] = -std::sin(angle);
+        result.m[2][2] = std::cos(angle);
+        return result;
+    }
+
+    static mat4 rotationZ(T angle) {
+        mat4 result = identity();
+        result.m[0][0] = std::cos(angle);
+        result.m[0][1] = -std::sin(angle);
+        result.m[1][0] = std::sin(angle);
+        result.m[1][1] = std::cos(angle);
+        return result;
+    }
+
+    // View to clip space, fovY in radians. Clip w is the view depth, and
+    // z/w goes from -1 on the near plane to 1 on the far one.
+    static mat4 perspective(T fovY, T aspect, T near, T far) {
+        const T focal = 1/std::tan(fovY/2);
+        mat4 result;
+        result.m[0][0] = focal/aspect;
+        result.m[1][1] = focal;
+        result.m[2][2] = (far + near)/(far - near);
+        result.m[2][3] = -2*far*near/(far - near);
+        result.m[3][2] = 1;
+        return result;
+    }
+
+    // Normalized device x and y in [-1, 1] to pixels, y up like Framebuffer.
+    static constexpr mat4 viewport(T width, T height) {
+        mat4 result = identity();
+        result.m[0][0] = width/2;
+        result.m[0][3] = width/2;
+        result.m[1][1] = height/2;
+        result.m[1][3] = height/2;
+        return result;
+    }
+};
+
+using mat4_t = mat4<scalar_t>;
+using mat4d_t = mat4<double>;
+
+template <typename U, typename T>
+constexpr mat4<U> matCast(mat4<T> const & a) {
+    mat4<U> result;
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            result.m[row][col] = static_cast<U>(a.m[row][col]);
+        }
+    }
+    return result;
 }
 
-inline vec3_t operator-(vec3_t const & a, vec3_t const & b) {
-    return vec3_t{
-        a.x - b.x,
-        a.y - b.y,
-        a.z - b.z
-    };
+template <typename T>
+constexpr mat4<T> operator*(mat4<T> const & a, mat4<T> const & b) {
+    mat4<T> result;
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            result.m[row][col] =
+                a.m[row][0]*b.m[0][col] +
+                a.m[row][1]*b.m[1][col] +
+                a.m[row][2]*b.m[2][col] +
+                a.m[row][3]*b.m[3][col];
+        }
+    }
+    return result;
 }
 
-inline vec3_t operator-(vec3_t const & vec) {
-    return vec3_t{
-        -vec.x,
-        -vec.y,
-        -vec.z
+template <typename T>
+constexpr vec<T, 4> operator*(mat4<T> const & a, vec<T, 4> const & vec) {
+    auto row = [&](int i) {
+        return a.m[i][0]*vec.x + a.m[i][1]*vec.y + a.m[i][2]*vec.z + a.m[i][3]*vec.w;
+    };
+    return simplegl::vec<T, 4>{
+        row(0),
+        row(1),
+        row(2),
+        row(3)
     };
 }
 
-inline vec3_t normalize(vec3_t const & vec) {
-    vec3_t normal = vec;
-    return normal.normalize();
+// Point transform, w = 1, without the perspective divide.
+template <typename T>
+constexpr vec<T, 4> transformPoint(mat4<T> const & a, vec<T, 3> const & point) {
+    return a * vec<T, 4>{point.x, point.y, point.z, 1};
 }
 
-inline double dot(vec3_t const & a, vec3_t const & b) {
-        return  (a.x * b.x) +
-                (a.y * b.y) +
-                (a.z * b.z);
-}
+// Empty when the matrix is singular.
+template <typename T>
+constexpr std::optional<mat4<T>> inverse(mat4<T> const & a) {
+    auto const & m = a.m;
 
-inline vec3_t cross(vec3_t const & a, vec3_t const & b) {
-    return vec3_t{
-        (a.y * b.z) - (a.z * b.y),
-        (a.z * b.x) - (a.x * b.z),
-        (a.x * b.y) - (a.y * b.x)
-    };
+    // 2x2 determinants of the top two and the bottom two rows
+    const T s0 = m[0][0]*m[1][1] - m[1][0]*m[0][1];
+    const T s1 = m[0][0]*m[1][2] - m[1][0]*m[0][2];
+    const T s2 = m[0][0]*m[1][3] - m[1][0]*m[0][3];
+    const T s3 = m[0][1]*m[1][2] - m[1][1]*m[0][2];
+    const T s4 = m[0][1]*m[1][3] - m[1][1]*m[0][3];
+    const T s5 = m[0][2]*m[1][3] - m[1][2]*m[0][3];
+
+    const T c5 = m[2][2]*m[3][3] - m[3][2]*m[2][3];
+    const T c4 = m[2][1]*m[3][3] - m[3][1]*m[2][3];
+    const T c3 = m[2][1]*m[3][2] - m[3][1]*m[2][2];
+    const T c2 = m[2][0]*m[3][3] - m[3][0]*m[2][3];
+    const T c1 = m[2][0]*m[3][2] - m[3][0]*m[2][2];
+    const T c0 = m[2][0]*m[3][1] - m[3][0]*m[2][1];
+
+    const T determinant = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+    // Also catches NaN and infinite entries
+    if (!(determinant != 0 && determinant - determinant == 0)) {
+        return std::nullopt;
+    }
+    const T invDet = 1/determinant;
+
+    mat4<T> result;
+    auto & r = result.m;
+    r[0][0] = ( m[1][1]*c5 - m[1][2]*c4 + m[1][3]*c3)*invDet;
+    r[0][1] = (-m[0][1]*c5 + m[0][2]*c4 - m[0][3]*c3)*invDet;
+    r[0][2] = ( m[3][1]*s5 - m[3][2]*s4 + m[3][3]*s3)*invDet;
+    r[0][3] = (-m[2][1]*s5 + m[2][2]*s4 - m[2][3]*s3)*invDet;
+
+    r[1][0] = (-m[1][0]*c5 + m[1][2]*c2 - m[1][3]*c1)*invDet;
+    r[1][1] = ( m[0][0]*c5 - m[0][2]*c2 + m[0][3]*c1)*invDet;
+    r[1][2] = (-m[3][0]*s5 + m[3][2]*s2 - m[3][3]*s1)*invDet;
+    r[1][3] = ( m[2][0]*s5 - m[2][2]*s2 + m[2][3]*s1)*invDet;
+
+    r[2][0] = ( m[1][0]*c4 - m[1][1]*c2 + m[1][3]*c0)*invDet;
+    r[2][1] = (-m[0][0]*c4 + m[0][1]*c2 - m[0][3]*c0)*invDet;
+    r[2][2] = ( m[3][0]*s4 - m[3][1]*s2 + m[3][3]*s0)*invDet;
+    r[2][3] = (-m[2][0]*s4 + m[2][1]*s2 - m[2][3]*s0)*invDet;
+
+    r[3][0] = (-m[1][0]*c3 + m[1][1]*c1 - m[1][2]*c0)*invDet;
+    r[3][1] = ( m[0][0]*c3 - m[0][1]*c1 + m[0][2]*c0)*invDet;
+    r[3][2] = (-m[3][0]*s3 + m[3][1]*s1 - m[3][2]*s0)*invDet;
+    r[3][3] = ( m[2][0]*s3 - m[2][1]*s1 + m[2][2]*s0)*invDet;
+    return result;
 }
 
-}
\ No newline at end of file
+}
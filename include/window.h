@@ -1,35 +1,45 @@
 #pragma once
 
-#include <vector>
 #include <optional>
 
 #include <SDL2/SDL.h>
 
+#include "framebuffer.h"
+
 namespace simplegl
 {
 
+// Presents a Framebuffer on screen. All drawing goes through the Framebuffer,
+// the window only owns the SDL objects and uploads the finished color buffer.
 struct Window {
 
 
-static std::optional<Window> Create(int window_width, int window_height);
+// With vsync, presenting waits for the display refresh.
+static std::optional<Window> Create(int window_width, int window_height, bool vsync = false);
 
 void setupDrawingBuffer();
 
-void drawPixel(int x, int y, uint32_t pixel_value);
-
-void clearColorBuffer(uint32_t color);
-
-void renderColorBuffer();
-
-void drawGrid(int multiple);
+void renderColorBuffer(Framebuffer const & framebuffer);
 
-void drawRectangle(int x_pos, int y_pos, int width, int height, uint32_t color);
+// Same upload, done in bands of rows; each band gets its background restored
+// right after it is uploaded, while it is still in cache, which fuses the
+// upload with the clear of the next frame.
+void renderColorBufferAndRestore(Framebuffer & framebuffer);
 
-void drawLine(int x0, int y0, int x1, int y1, uint32_t color);
+// Zero-copy upload: locks the streaming texture and points the framebuffer
+// at its pixels, so the frame is drawn straight into it. Locked pixels start
+// undefined, the frame has to cover all of them. Returns false and leaves
+// the framebuffer alone when the texture cannot be locked, from then on
+// without trying again; renderColorBuffer() is the fallback.
+bool lockColorBuffer(Framebuffer & framebuffer);
 
-void drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
+// Ends a frame started by lockColorBuffer(): points the framebuffer back at
+// its own color buffer, unlocks the texture and copies it to the renderer.
+void unlockColorBuffer(Framebuffer & framebuffer);
 
-void fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
+// Copies the texture as last uploaded to the renderer again, to present an
+// unchanged frame without uploading it.
+void renderColorBufferTexture();
 
 void renderPresent();
 
@@ -49,10 +59,6 @@ void setColorBufferTexture(SDL_Texture* colorBufferTexture) {
     _color_buffer_texture = colorBufferTexture;
 }
 
-std::vector<uint32_t>& colorBuffer() {
-    return _color_buffer;
-}
-
 ~Window();
 
 Window(const Window&) = delete;
@@ -61,17 +67,14 @@ Window(Window&&);
 Window& operator=(Window&&);
 
 private:
-void fillFlatBottomTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
-void fillFlatTopTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
-
 Window() = default;
 
 int _window_width = 0;
 int _window_height = 0;
-std::vector<uint32_t> _color_buffer;
 SDL_Window* _window = nullptr;
 SDL_Renderer* _renderer = nullptr;
 SDL_Texture* _color_buffer_texture = nullptr;
+bool _texture_lockable = true;
 bool _is_moved = false;
 
 };
@@ -0,0 +1,74 @@
+#include "adjacency.h"
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+namespace simplegl
+{
+
+std::vector<FaceNeighbors> buildFaceNeighbors(std::span<uint32_t const> triangles) {
+    // Every face edge by its lower and higher vertex, sorted so the faces
+    // sharing an edge end up next to each other
+    struct HalfEdge {
+        uint32_t from;
+        uint32_t to;
+        uint32_t face;
+        uint32_t corner;
+
+        bool operator<(HalfEdge const & other) const {
+            return std::tie(from, to, face, corner) < std::tie(other.from, other.to, other.face, other.corner);
+        }
+    };
+
+    const size_t faceCount = triangles.size()/3;
+    std::vector<HalfEdge> halfEdges;
+    halfEdges.reserve(faceCount*3);
+    for (size_t face = 0; face < faceCount; ++face) {
+        for (uint32_t corner = 0; corner < 3; ++corner) {
+            uint32_t from = triangles[3*face + corner];
+            uint32_t to = triangles[3*face + (corner + 1) % 3];
+            if (from > to) std::swap(from, to);
+            halfEdges.emplace_back(HalfEdge{from, to, static_cast<uint32_t>(face), corner});
+        }
+    }
+    std::sort(halfEdges.begin(), halfEdges.end());
+
+    std::vector<FaceNeighbors> neighbors(faceCount, FaceNeighbors{kNoFace, kNoFace, kNoFace});
+    for (size_t i = 0; i + 1 < halfEdges.size(); ++i) {
+        HalfEdge const & a = halfEdges[i];
+        HalfEdge const & b = halfEdges[i + 1];
+        if (a.from != b.from || a.to != b.to || a.from == a.to) continue;
+
+        neighbors[a.face][a.corner] = b.face;
+        neighbors[b.face][b.corner] = a.face;
+        ++i;
+    }
+    return neighbors;
+}
+
+std::vector<FaceNeighbors> buildFaceNeighbors(Mesh const & mesh) {
+    std::vector<uint32_t> triangles;
+    triangles.reserve(mesh.faces().size()*3);
+    for (Face const & face : mesh.faces()) {
+        for (VertexIndex const & index : face.indexes) {
+            triangles.emplace_back(static_cast<uint32_t>(index.vertex));
+        }
+    }
+    return buildFaceNeighbors(triangles);
+}
+
+std::vector<FaceNeighbors> buildFaceNeighbors(MeshletMesh const & meshlets) {
+    std::vector<uint32_t> triangles;
+    triangles.reserve(meshlets.triangles.size());
+    for (Meshlet const & meshlet : meshlets.meshlets) {
+        uint32_t const * vertexes = &meshlets.vertexes[meshlet.vertexOffset];
+        uint8_t const * local = &meshlets.triangles[3*meshlet.triangleOffset];
+        for (uint32_t i = 0; i < 3*meshlet.triangleCount; ++i) {
+            triangles.emplace_back(vertexes[local[i]]);
+        }
+    }
+    return buildFaceNeighbors(triangles);
+}
+
+}
@@ -0,0 +1,290 @@
+#include "clipping.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+
+#include "framebuffer.h"
+
+namespace
+{
+
+using simplegl::vec4d_t;
+
+// Inside where dot(normal, p) + offset >= 0, p in homogeneous clip space.
+struct Plane {
+    vec4d_t normal;
+    double offset = 0.0;
+
+    double distance(vec4d_t const & p) const {
+        return dot(normal, p) + offset;
+    }
+};
+
+// One more than the screen so wireframe endpoints rounding onto the border
+// pixels are not rejected with their triangle
+constexpr double kRejectMargin = 1.0;
+
+// Outcode bits of a line endpoint outside each plane triangles are rejected
+// against, and of one the line has to be clipped at
+constexpr unsigned kOutNear = 1;
+constexpr unsigned kOutFar = 2;
+constexpr unsigned kOutLeft = 4;
+constexpr unsigned kOutRight = 8;
+constexpr unsigned kOutBottom = 16;
+constexpr unsigned kOutTop = 32;
+constexpr unsigned kOutPlanes = 63;
+constexpr unsigned kOutNeedsClipping = 64;
+
+// A triangle clipped by the five planes has at most eight corners
+constexpr size_t kMaxPolygonSize = 8;
+
+struct Polygon {
+    std::array<vec4d_t, kMaxPolygonSize> vertexes;
+    // Whether the edge from vertexes[i] to the next one is part of the triangle
+    std::array<bool, kMaxPolygonSize> edges;
+    size_t size = 0;
+};
+
+// Sutherland-Hodgman step, keeps the part of polygon inside plane.
+Polygon clipPolygon(Polygon const & polygon, Plane const & plane) {
+    Polygon result;
+    for (size_t i = 0; i < polygon.size; ++i) {
+        const size_t next = (i + 1) % polygon.size;
+        vec4d_t const & current = polygon.vertexes[i];
+        const double currentDistance = plane.distance(current);
+        const double nextDistance = plane.distance(polygon.vertexes[next]);
+        const bool currentInside = currentDistance >= 0.0;
+        const bool nextInside = nextDistance >= 0.0;
+
+        if (currentInside) {
+            result.vertexes[result.size] = current;
+            result.edges[result.size] = polygon.edges[i];
+            ++result.size;
+        }
+        if (currentInside != nextInside) {
+            const double t = currentDistance/(currentDistance - nextDistance);
+            result.vertexes[result.size] = current + (polygon.vertexes[next] - current)*t;
+            // Going in, the rest of the original edge follows; going out,
+            // the next edge runs along the plane
+            result.edges[result.size] = nextInside && polygon.edges[i];
+            ++result.size;
+        }
+    }
+    return result;
+}
+
+bool allOutside(Plane const & plane, vec4d_t const & a, vec4d_t const & b, vec4d_t const & c) {
+    return plane.distance(a) < 0.0 && plane.distance(b) < 0.0 && plane.distance(c) < 0.0;
+}
+
+bool anyOutside(Plane const & plane, vec4d_t const & a, vec4d_t const & b, vec4d_t const & c) {
+    return plane.distance(a) < 0.0 || plane.distance(b) < 0.0 || plane.distance(c) < 0.0;
+}
+
+// Left, right, bottom and top sides margin pixels beyond the screen
+std::array<Plane, 4> sidePlanes(simplegl::ClipVolume const & volume, double margin) {
+    return {
+        Plane{{1.0, 0.0, 0.0, margin}, 0.0},
+        Plane{{-1.0, 0.0, 0.0, volume.width + margin}, 0.0},
+        Plane{{0.0, 1.0, 0.0, margin}, 0.0},
+        Plane{{0.0, -1.0, 0.0, volume.height + margin}, 0.0}
+    };
+}
+
+
+// Cohen-Sutherland outcode of a line endpoint, see kOutNear
+unsigned outcode(simplegl::ClipVolume const & volume, vec4d_t const & p) {
+    const double margin = kRejectMargin*p.w;
+    const double guardBand = volume.guardBand*p.w;
+
+    unsigned code = 0;
+    if (p.w < volume.near) code |= kOutNear | kOutNeedsClipping;
+    if (p.w > volume.far) code |= kOutFar;
+    if (p.x < -margin) code |= kOutLeft;
+    if (p.x > volume.width*p.w + margin) code |= kOutRight;
+    if (p.y < -margin) code |= kOutBottom;
+    if (p.y > volume.height*p.w + margin) code |= kOutTop;
+    if (p.x < -guardBand || p.x > volume.width*p.w + guardBand || p.y < -guardBand || p.y > volume.height*p.w + guardBand) {
+        code |= kOutNeedsClipping;
+    }
+    return code;
+}
+
+}
+
+namespace simplegl
+{
+
+bool backFacing(vec4_t const & a, vec4_t const & b, vec4_t const & c) {
+    const vec4d_t da = vecCast<double>(a);
+    const vec4d_t db = vecCast<double>(b);
+    const vec4d_t dc = vecCast<double>(c);
+    const double orientation =
+        da.x*(db.y*dc.w - db.w*dc.y) -
+        da.y*(db.x*dc.w - db.w*dc.x) +
+        da.w*(db.x*dc.y - db.y*dc.x);
+    return orientation > 0.0;
+}
+
+ClipResult clipTriangle(ClipVolume const & volume, vec4_t const & a, vec4_t const & b, vec4_t const & c, std::vector<vec3_t> & vertexes, std::vector<uint8_t> & edgeMasks) {
+
+    const vec4d_t da = vecCast<double>(a);
+    const vec4d_t db = vecCast<double>(b);
+    const vec4d_t dc = vecCast<double>(c);
+
+    const Plane nearPlane{{0.0, 0.0, 0.0, 1.0}, -volume.near};
+    const Plane farPlane{{0.0, 0.0, 0.0, -1.0}, volume.far};
+
+    if (allOutside(nearPlane, da, db, dc) || allOutside(farPlane, da, db, dc)) {
+        return ClipResult::Rejected;
+    }
+    for (Plane const & side : sidePlanes(volume, kRejectMargin)) {
+        if (allOutside(side, da, db, dc)) {
+            return ClipResult::Rejected;
+        }
+    }
+
+    const auto guardBand = sidePlanes(volume, volume.guardBand);
+    bool needsClipping = anyOutside(nearPlane, da, db, dc);
+    for (Plane const & side : guardBand) {
+        needsClipping = needsClipping || anyOutside(side, da, db, dc);
+    }
+
+    if (!needsClipping) {
+        for (vec4_t const & vertex : {a, b, c}) {
+            const scalar_t invW = 1/vertex.w;
+            vertexes.emplace_back(vec3_t{vertex.x*invW, vertex.y*invW, invW});
+        }
+        edgeMasks.emplace_back(kAllTriangleEdges);
+        return ClipResult::Inside;
+    }
+
+    Polygon polygon;
+    polygon.vertexes[0] = da;
+    polygon.vertexes[1] = db;
+    polygon.vertexes[2] = dc;
+    polygon.edges = {true, true, true};
+    polygon.size = 3;
+
+    // The near plane first: the guard band planes assume w > 0
+    polygon = clipPolygon(polygon, nearPlane);
+    for (Plane const & side : guardBand) {
+        if (polygon.size < 3) break;
+        polygon = clipPolygon(polygon, side);
+    }
+
+    if (polygon.size < 3) {
+        return ClipResult::Rejected;
+    }
+
+    std::array<vec3_t, kMaxPolygonSize> projected;
+    for (size_t i = 0; i < polygon.size; ++i) {
+        vec4d_t const & vertex = polygon.vertexes[i];
+        projected[i] = vecCast<scalar_t>(vec3d_t{vertex.x/vertex.w, vertex.y/vertex.w, 1.0/vertex.w});
+    }
+
+    // Fan around the first corner, only its first and last triangles have
+    // an outer edge ending at it
+    for (size_t i = 1; i + 1 < polygon.size; ++i) {
+        vertexes.emplace_back(projected[0]);
+        vertexes.emplace_back(projected[i]);
+        vertexes.emplace_back(projected[i + 1]);
+
+        uint8_t mask = 0;
+        if (i == 1 && polygon.edges[0]) mask |= kTriangleEdgeAB;
+        if (polygon.edges[i]) mask |= kTriangleEdgeBC;
+        if (i + 2 == polygon.size && polygon.edges[i + 1]) mask |= kTriangleEdgeCA;
+        edgeMasks.emplace_back(mask);
+    }
+    return ClipResult::Clipped;
+}
+
+bool clipLine(ClipVolume const & volume, vec4_t const & a, vec4_t const & b, std::vector<vec3_t> & vertexes) {
+
+    // Clipped the same way round whichever face passes the edge, so both
+    // give the same endpoints
+    if (std::tie(b.x, b.y, b.z, b.w) < std::tie(a.x, a.y, a.z, a.w)) {
+        return clipLine(volume, b, a, vertexes);
+    }
+
+    const vec4d_t da = vecCast<double>(a);
+    const vec4d_t db = vecCast<double>(b);
+
+    const unsigned outcodeA = outcode(volume, da);
+    const unsigned outcodeB = outcode(volume, db);
+    if (outcodeA & outcodeB & kOutPlanes) {
+        return false;
+    }
+
+    if (!((outcodeA | outcodeB) & kOutNeedsClipping)) {
+        for (vec4_t const & vertex : {a, b}) {
+            const scalar_t invW = 1/vertex.w;
+            vertexes.emplace_back(vec3_t{vertex.x*invW, vertex.y*invW, invW});
+        }
+        return true;
+    }
+
+    // Part of ab kept, as parameters along it. The near plane first: the
+    // guard band planes assume w > 0.
+    double from = 0.0;
+    double to = 1.0;
+    const auto guardBand = sidePlanes(volume, volume.guardBand);
+    for (Plane const & plane : {Plane{{0.0, 0.0, 0.0, 1.0}, -volume.near}, guardBand[0], guardBand[1], guardBand[2], guardBand[3]}) {
+        const double distanceA = plane.distance(da);
+        const double distanceB = plane.distance(db);
+        if (distanceA >= 0.0 && distanceB >= 0.0) continue;
+        if (distanceA < 0.0 && distanceB < 0.0) return false;
+
+        const double t = distanceA/(distanceA - distanceB);
+        if (distanceA < 0.0) {
+            from = std::max(from, t);
+        } else {
+            to = std::min(to, t);
+        }
+    }
+    if (from > to) {
+        return false;
+    }
+
+    for (double t : {from, to}) {
+        const vec4d_t vertex = da + (db - da)*t;
+        vertexes.emplace_back(vecCast<scalar_t>(vec3d_t{vertex.x/vertex.w, vertex.y/vertex.w, 1.0/vertex.w}));
+    }
+    return true;
+}
+
+FrustumPlanes frustumPlanes(ClipVolume const & volume, mat4d_t const & modelToClip) {
+    auto row = [&](int r) {
+        return vec4d_t{modelToClip.m[r][0], modelToClip.m[r][1], modelToClip.m[r][2], modelToClip.m[r][3]};
+    };
+    const vec4d_t x = row(0);
+    const vec4d_t y = row(1);
+    const vec4d_t w = row(3);
+
+    FrustumPlanes planes = {
+        x + w*kRejectMargin,
+        w*(volume.width + kRejectMargin) - x,
+        y + w*kRejectMargin,
+        w*(volume.height + kRejectMargin) - y,
+        w - vec4d_t{0.0, 0.0, 0.0, volume.near},
+        vec4d_t{0.0, 0.0, 0.0, volume.far} - w
+    };
+    for (vec4d_t & plane : planes) {
+        const double scale = std::sqrt(plane.x*plane.x + plane.y*plane.y + plane.z*plane.z);
+        if (scale > 0.0) plane = plane/scale;
+    }
+    return planes;
+}
+
+bool sphereOutside(FrustumPlanes const & planes, vec3d_t const & center, double radius) {
+    for (vec4d_t const & plane : planes) {
+        if (plane.x*center.x + plane.y*center.y + plane.z*center.z + plane.w < -radius) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
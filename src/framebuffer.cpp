@@ -0,0 +1,478 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "profiler.h"
+
+namespace
+{
+
+// Whether the line from (x0, y0) to (x1, y1) runs backwards along its major
+// axis. Lines are drawn from their lower end so a line covers the same
+// pixels whichever way round its endpoints are given.
+bool reversedLine(int x0, int y0, int x1, int y1) {
+    return std::abs(x1 - x0) >= std::abs(y1 - y0) ? x1 < x0 : y1 < y0;
+}
+
+// Pixel holding coordinate v, pixel i spanning [i, i + 1).
+int pixelOf(simplegl::scalar_t v) {
+    return static_cast<int>(std::floor(v));
+}
+
+// Pixels the horizontal line from x0 to x1 on row y covers inside clip.
+int clippedRowPixels(int x0, int x1, int y, simplegl::Rect const & clip) {
+    if (y < clip.y0 || y >= clip.y1) {
+        return 0;
+    }
+    const int lo = std::max(std::min(x0, x1), clip.x0);
+    const int hi = std::min(std::max(x0, x1), clip.x1 - 1);
+    return std::max(0, hi - lo + 1);
+}
+
+// Integer Bresenham line from (x0, y0) to (x1, y1), y growing upwards in
+// buffers of the given height stored top row first. Step i moves one pixel
+// along the major axis and round(i*minor/major) pixels along the minor one,
+// halves away from the start, so a line covers the same pixels whatever clip
+// it is drawn with. The steps landing inside clip are found once up front,
+// the loop has no bounds checks. plot(colorIndex, depthIndex, i) gets the
+// index of the pixel of step i in buffers of colorPitch and depthPitch
+// pixels per row.
+template<typename Plot>
+void walkLine(int x0, int y0, int x1, int y1, simplegl::Rect const & clip, int height, int64_t colorPitch, int64_t depthPitch, Plot && plot) {
+    const bool xMajor = std::abs(x1 - x0) >= std::abs(y1 - y0);
+    const int64_t majorStart = xMajor ? x0 : y0;
+    const int64_t minorStart = xMajor ? y0 : x0;
+    const int64_t majorDelta = xMajor ? x1 - x0 : y1 - y0;
+    const int64_t minorDelta = xMajor ? y1 - y0 : x1 - x0;
+    const int64_t majorSign = majorDelta < 0 ? -1 : 1;
+    const int64_t minorSign = minorDelta < 0 ? -1 : 1;
+    const int64_t n = std::abs(majorDelta);
+    const int64_t d = std::abs(minorDelta);
+
+    // Pixel range along each axis, inclusive
+    const int64_t majorLo = xMajor ? clip.x0 : clip.y0;
+    const int64_t majorHi = (xMajor ? clip.x1 : clip.y1) - 1;
+    const int64_t minorLo = xMajor ? clip.y0 : clip.x0;
+    const int64_t minorHi = (xMajor ? clip.y1 : clip.x1) - 1;
+
+    int64_t first = 0;
+    int64_t last = n;
+
+    // Major axis: majorStart + majorSign*i
+    first = std::max(first, majorSign > 0 ? majorLo - majorStart : majorStart - majorHi);
+    last = std::min(last, majorSign > 0 ? majorHi - majorStart : majorStart - majorLo);
+
+    // Minor axis: minorStart + minorSign*k(i), k(i) = (2*i*d + n)/(2*n)
+    // rounded down, non decreasing in i
+    const int64_t kLo = minorSign > 0 ? minorLo - minorStart : minorStart - minorHi;
+    const int64_t kHi = minorSign > 0 ? minorHi - minorStart : minorStart - minorLo;
+    if (kHi < 0) return;
+    if (d == 0) {
+        if (kLo > 0) return;
+    } else {
+        // Smallest i with k(i) >= kLo, largest with k(i) <= kHi
+        if (kLo > 0) first = std::max(first, (2*n*kLo - n + 2*d - 1)/(2*d));
+        last = std::min(last, (2*n*kHi + n + 2*d - 1)/(2*d) - 1);
+    }
+    if (first > last) return;
+
+    // Pixel index strides, rows are stored top row first
+    const int64_t colorMajorStride = xMajor ? majorSign : -majorSign*colorPitch;
+    const int64_t colorMinorStride = xMajor ? -minorSign*colorPitch : minorSign;
+    const int64_t depthMajorStride = xMajor ? majorSign : -majorSign*depthPitch;
+    const int64_t depthMinorStride = xMajor ? -minorSign*depthPitch : minorSign;
+
+    const int64_t twoN = 2*std::max<int64_t>(n, 1);
+    int64_t numerator = 2*first*d + n;
+    const int64_t k = numerator/twoN;
+    int64_t error = numerator - k*twoN;
+
+    const int64_t startX = xMajor ? majorStart + majorSign*first : minorStart + minorSign*k;
+    const int64_t startY = xMajor ? minorStart + minorSign*k : majorStart + majorSign*first;
+    int64_t colorIndex = colorPitch*(height - 1 - startY) + startX;
+    int64_t depthIndex = depthPitch*(height - 1 - startY) + startX;
+
+    for (int64_t i = first; i <= last; ++i) {
+        plot(static_cast<size_t>(colorIndex), static_cast<size_t>(depthIndex), static_cast<int>(i));
+        colorIndex += colorMajorStride;
+        depthIndex += depthMajorStride;
+        error += 2*d;
+        if (error >= twoN) {
+            error -= twoN;
+            colorIndex += colorMinorStride;
+            depthIndex += depthMinorStride;
+        }
+    }
+}
+
+}
+
+namespace simplegl
+{
+
+Framebuffer::Framebuffer(int width, int height) :
+_width{width},
+_height{height},
+_color_buffer(static_cast<size_t>(width)*height, static_cast<uint32_t>(0)),
+_color_pitch{static_cast<size_t>(width)},
+_depth_buffer(static_cast<size_t>(width)*height, 0.0f),
+_hiz_blocks_x{(width + kHiZBlockSize - 1)/kHiZBlockSize},
+_hiz_blocks_y{(height + kHiZBlockSize - 1)/kHiZBlockSize},
+_hiz(static_cast<size_t>(_hiz_blocks_x)*_hiz_blocks_y, 0.0f),
+_hiz_dirty(_hiz.size(), 0) {}
+
+void Framebuffer::drawPixel(int x, int y, uint32_t pixel_value) {
+    y = _height - 1 - y; 
+    if ((x >= 0) && (x < _width) && (y >= 0) && (y < _height)) {
+        colorTarget()[_color_pitch*y + x] = pixel_value;
+    }
+}
+
+void Framebuffer::clearColorBuffer(uint32_t color) {
+    SIMPLEGL_ZONE("clearColorBuffer");
+    for (int y = 0; y < _height; ++y) {
+        std::fill_n(row(y), _width, color);
+    }
+}
+
+void Framebuffer::clearDepthBuffer() {
+    std::fill(_depth_buffer.begin(), _depth_buffer.end(), 0.0f);
+    std::fill(_hiz.begin(), _hiz.end(), 0.0f);
+    std::fill(_hiz_dirty.begin(), _hiz_dirty.end(), 0);
+}
+
+void Framebuffer::captureBackground() {
+    _background.resize(static_cast<size_t>(_width)*_height);
+    for (int y = 0; y < _height; ++y) {
+        std::memcpy(_background.data() + static_cast<size_t>(_width)*(_height - 1 - y), row(y), _width*sizeof(uint32_t));
+    }
+}
+
+void Framebuffer::setColorTarget(uint32_t* pixels, int pitch) {
+    assert(pixels && pitch % sizeof(uint32_t) == 0 && pitch/static_cast<int>(sizeof(uint32_t)) >= _width);
+    _color_target = pixels;
+    _color_pitch = pitch/sizeof(uint32_t);
+}
+
+void Framebuffer::resetColorTarget() {
+    _color_target = nullptr;
+    _color_pitch = static_cast<size_t>(_width);
+}
+
+void Framebuffer::restoreBackground() {
+    restoreBackground(bounds());
+}
+
+void Framebuffer::restoreBackground(Rect const & clip) {
+    assert(_background.size() == _color_buffer.size());
+
+    const size_t count = static_cast<size_t>(clip.x1 - clip.x0);
+    for (int y = clip.y0; y < clip.y1; ++y) {
+        const size_t offset = static_cast<size_t>(_width)*(_height - 1 - y) + clip.x0;
+        std::memcpy(row(y) + clip.x0, _background.data() + offset, count*sizeof(uint32_t));
+        std::memset(_depth_buffer.data() + offset, 0, count*sizeof(float));
+    }
+
+    // Blocks only partly inside clip may still hold depth from outside it,
+    // they are recomputed on their next query instead.
+    for (int blockY = clip.y0/kHiZBlockSize; blockY*kHiZBlockSize < clip.y1; ++blockY) {
+        for (int blockX = clip.x0/kHiZBlockSize; blockX*kHiZBlockSize < clip.x1; ++blockX) {
+            const size_t index = static_cast<size_t>(blockY)*_hiz_blocks_x + blockX;
+            const bool inside =
+                blockX*kHiZBlockSize >= clip.x0 &&
+                blockY*kHiZBlockSize >= clip.y0 &&
+                std::min((blockX + 1)*kHiZBlockSize, _width) <= clip.x1 &&
+                std::min((blockY + 1)*kHiZBlockSize, _height) <= clip.y1;
+            _hiz[index] = 0.0f;
+            _hiz_dirty[index] = !inside;
+        }
+    }
+}
+
+float Framebuffer::hiZ(int blockX, int blockY) {
+    if (!_hiz_enabled) {
+        return -std::numeric_limits<float>::infinity();
+    }
+
+    const size_t index = static_cast<size_t>(blockY)*_hiz_blocks_x + blockX;
+
+    if (_hiz_dirty[index]) {
+        const int x0 = blockX*kHiZBlockSize;
+        const int x1 = std::min(x0 + kHiZBlockSize, _width);
+        const int y0 = blockY*kHiZBlockSize;
+        const int y1 = std::min(y0 + kHiZBlockSize, _height);
+
+        float farthest = depthRow(y0)[x0];
+        for (int y = y0; y < y1; ++y) {
+            const float* depth = depthRow(y);
+            for (int x = x0; x < x1; ++x) {
+                farthest = std::min(farthest, depth[x]);
+            }
+        }
+
+        _hiz[index] = farthest;
+        _hiz_dirty[index] = 0;
+    }
+
+    return _hiz[index];
+}
+
+void Framebuffer::drawGrid(int multiple) {
+    SIMPLEGL_ZONE("drawGrid");
+    for (int y = 0; y < _height; ++y) {
+        for (int x = 0; x < _width; ++x) {
+            if ((y%multiple == 0) || (x%multiple == 0)) {
+                drawPixel(x, y, 0xFF444444);
+            }
+        }
+    }
+}
+
+void Framebuffer::drawRectangle(int x_pos, int y_pos, int width, int height, uint32_t color) {
+    int y_final_pos = y_pos + height;
+    int x_final_pos = x_pos + width;
+    for (int y = y_pos; y < y_final_pos; ++y) {
+        for (int x = x_pos; x < x_final_pos; ++x) {
+            drawPixel(x, y, color);
+        }
+    }
+}
+
+void Framebuffer::drawLine(int x0, int y0, int x1, int y1, uint32_t color) {
+    drawLine(x0, y0, x1, y1, color, bounds());
+}
+
+void Framebuffer::drawLine(int x0, int y0, int x1, int y1, uint32_t color, Rect const & clip) {
+    if (reversedLine(x0, y0, x1, y1)) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    uint32_t* colors = colorTarget();
+    walkLine(x0, y0, x1, y1, clip, _height, _color_pitch, _width, [colors, color](size_t index, size_t, int) {
+        colors[index] = color;
+    });
+}
+
+void Framebuffer::drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
+    drawTriangle(x0, y0, x1, y1, x2, y2, color, bounds());
+}
+
+void Framebuffer::drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip, uint8_t edges) {
+    if (edges & kTriangleEdgeAB) drawLine(x0, y0, x1, y1, color, clip);
+    if (edges & kTriangleEdgeBC) drawLine(x1, y1, x2, y2, color, clip);
+    if (edges & kTriangleEdgeCA) drawLine(x2, y2, x0, y0, color, clip);
+}
+
+void Framebuffer::drawLine(vec2_t const & a, vec2_t const & b, uint32_t color, Rect const & clip) {
+    drawLine(pixelOf(a.x), pixelOf(a.y), pixelOf(b.x), pixelOf(b.y), color, clip);
+}
+
+void Framebuffer::drawTriangle(vec2_t const & a, vec2_t const & b, vec2_t const & c, uint32_t color, Rect const & clip, uint8_t edges) {
+    if (edges & kTriangleEdgeAB) drawLine(a, b, color, clip);
+    if (edges & kTriangleEdgeBC) drawLine(b, c, color, clip);
+    if (edges & kTriangleEdgeCA) drawLine(c, a, color, clip);
+}
+
+void Framebuffer::drawLine(int x0, int y0, double z0, int x1, int y1, double z1, uint32_t color, Rect const & clip) {
+    // Relative slack for a line to still count as in front of the depth buffer
+    constexpr double depthBias = 1.0/256.0;
+
+    if (reversedLine(x0, y0, x1, y1)) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        std::swap(z0, z1);
+    }
+
+    const int sideLength = std::max({std::abs(x1 - x0), std::abs(y1 - y0), 1});
+    const double stepZ = (z1 - z0) / static_cast<double>(sideLength);
+
+    uint32_t* colors = colorTarget();
+    float const * depths = _depth_buffer.data();
+    walkLine(x0, y0, x1, y1, clip, _height, _color_pitch, _width, [=](size_t colorIndex, size_t depthIndex, int i) {
+        const double z = z0 + i*stepZ;
+        if (z*(1.0 + depthBias) >= depths[depthIndex]) {
+            colors[colorIndex] = color;
+        }
+    });
+}
+
+void Framebuffer::drawLine(vec3_t const & a, vec3_t const & b, uint32_t color, Rect const & clip) {
+    drawLine(pixelOf(a.x), pixelOf(a.y), a.z, pixelOf(b.x), pixelOf(b.y), b.z, color, clip);
+}
+
+void Framebuffer::drawTriangle(vec3_t const & a, vec3_t const & b, vec3_t const & c, uint32_t color, Rect const & clip, uint8_t edges) {
+    if (edges & kTriangleEdgeAB) drawLine(a, b, color, clip);
+    if (edges & kTriangleEdgeBC) drawLine(b, c, color, clip);
+    if (edges & kTriangleEdgeCA) drawLine(c, a, color, clip);
+}
+
+// We fill the triangle by dividing it into a bottom flat
+// and a top flat triangles, the final result looks like this:
+//
+//          (x0,y0)
+//            /  \
+//           /     \
+//          /        \
+//         /           \
+//        /              \
+//       /                 \
+//      /                     \
+//     /                         \
+// (x1,y1) ---------------------- (mx,my)
+//    \                           /
+//     \                        /
+//      \                     /
+//       \                  /
+//        \               /
+//         \            /
+//           \        /
+//             \     /
+//              \  /
+//             (x2,y2)
+
+int Framebuffer::fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
+    return fillTriangle(x0, y0, x1, y1, x2, y2, color, bounds());
+}
+
+int Framebuffer::fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip) {
+
+    // Sorting triangles such that y0 < y1 < y2
+
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    if (y1 > y2) {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
+
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    if (y0 == y1) {
+        return fillFlatTopTriangle(x1, y1, x0, y0, x2, y2, color, clip);    
+    } else if (y2 == y1) {
+        return fillFlatBottomTriangle(x0, y0, x1, y1, x2, y2, color, clip);
+    } else {
+    const double mx = x0 + (static_cast<double>((x2 - x0) * (y1 - y0)) / ( y2 - y0)) ;
+    const double my = y1;
+
+    // The middle row is drawn once, by the flat top half
+    return fillFlatBottomTriangle(x0, y0, x1, y1, mx, my, color, clip, false) +
+           fillFlatTopTriangle(x1, y1, mx, my, x2, y2, color, clip);
+    }
+    
+}
+
+// Flat bottom triangle looks like this:
+//
+//          (x0,y0)
+//            /  \
+//           /     \
+//          /        \
+//         /           \
+//        /              \
+//       /                 \
+//      /                     \
+//     /                         \
+// (x1,y1) ---------------------- (x2,y2)
+
+int Framebuffer::fillFlatBottomTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip, bool lastRow) {
+
+    // Slope x0,y0 -> x1,y1
+    const auto slopeStartX = (x1 - x0)/static_cast<double>(y1 - y0);
+
+    // Slope x0,y0 -> x2,y2
+    const auto slopeEndX = (x2 - x0)/static_cast<double>(y2 - y0);
+
+    double startX = x0;
+    double endX = x0;
+
+    int pixels = 0;
+    const int endY = lastRow ? y2 : y2 - 1;
+    for (int y = y0; y <= endY; ++y) {
+        const int rowStartX = static_cast<int>(startX + 0.5);
+        const int rowEndX = static_cast<int>(endX + 0.5);
+        drawLine(rowStartX, y, rowEndX, y, color, clip);
+        pixels += clippedRowPixels(rowStartX, rowEndX, y, clip);
+        startX += slopeStartX;
+        endX += slopeEndX;
+    }
+    return pixels;
+
+}
+
+// Flat top triangle looks like this:
+
+// (x0,y0) ---------------------- (x1,y1)
+//    \                           /
+//     \                        /
+//      \                     /
+//       \                  /
+//        \               /
+//         \            /
+//           \        /
+//             \     /
+//              \  /
+//             (x2,y2)
+
+int Framebuffer::fillFlatTopTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, Rect const & clip) {
+
+    // Slope x0,y0 -> x2,y2
+    const auto slopeStartX = (x2 - x0)/static_cast<double>(y2 - y0);
+
+    // Slope x1,y1 -> x2,y2
+    const auto slopeEndX = (x2 - x1)/static_cast<double>(y2 - y1);
+
+    double startX = x0;
+    double endX = x1;
+
+    int pixels = 0;
+    for (int y = y0; y <= y2; ++y) {
+        const int rowStartX = static_cast<int>(startX + 0.5);
+        const int rowEndX = static_cast<int>(endX + 0.5);
+        drawLine(rowStartX, y, rowEndX, y, color, clip);
+        pixels += clippedRowPixels(rowStartX, rowEndX, y, clip);
+        startX += slopeStartX;
+        endX += slopeEndX;
+    }
+    return pixels;
+}
+
+bool Framebuffer::writePPM(std::string_view path) const {
+    auto ofs = std::ofstream{std::string{path}, std::ios::binary};
+    if (!ofs) {
+        std::cerr << "Could not open " << path << " for writing\n";
+        return false;
+    }
+
+    ofs << "P6\n" << _width << ' ' << _height << "\n255\n";
+
+    uint32_t const * colors = _color_target ? _color_target : _color_buffer.data();
+    std::vector<char> row(static_cast<size_t>(_width)*3);
+    for (int y = 0; y < _height; ++y) {
+        const uint32_t* src = colors + _color_pitch*y;
+        for (int x = 0; x < _width; ++x) {
+            row[3*x] = static_cast<char>((src[x] >> 16) & 0xFF);
+            row[3*x + 1] = static_cast<char>((src[x] >> 8) & 0xFF);
+            row[3*x + 2] = static_cast<char>(src[x] & 0xFF);
+        }
+        ofs.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+}
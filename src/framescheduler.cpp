@@ -0,0 +1,107 @@
+#include "framescheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "profiler.h"
+
+namespace
+{
+
+// Sleeps can overshoot by a scheduler tick, the last stretch before the
+// deadline is spun instead
+constexpr auto kSpinTime = std::chrono::microseconds(1000);
+
+double percentile(std::vector<double> const & sorted, double fraction) {
+    const size_t rank = static_cast<size_t>(std::ceil(fraction*sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+}
+
+namespace simplegl
+{
+
+FrameTimeStats frameTimeStats(std::span<double const> frameTimesMs) {
+    FrameTimeStats result;
+    result.frames = frameTimesMs.size();
+    if (frameTimesMs.empty()) {
+        return result;
+    }
+
+    std::vector<double> sorted(frameTimesMs.begin(), frameTimesMs.end());
+    std::sort(sorted.begin(), sorted.end());
+    result.p50Ms = percentile(sorted, 0.50);
+    result.p95Ms = percentile(sorted, 0.95);
+    result.p99Ms = percentile(sorted, 0.99);
+    return result;
+}
+
+FrameScheduler::FrameScheduler(double targetFps) {
+    setTargetFps(targetFps);
+    _frame_times_ms.reserve(kFrameTimeWindow);
+    _work_times_ms.reserve(kFrameTimeWindow);
+}
+
+void FrameScheduler::setTargetFps(double targetFps) {
+    _target_fps = std::max(0.0, targetFps);
+    _period = _target_fps > 0.0 ?
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0/_target_fps)) :
+        Clock::duration::zero();
+    // Restart the deadlines from the next frame
+    _deadline = Clock::now() + _period;
+}
+
+void FrameScheduler::waitNextFrame() {
+    SIMPLEGL_ZONE("waitNextFrame");
+    const auto workEnd = Clock::now();
+    if (_period > Clock::duration::zero()) {
+        const auto sleepUntil = _deadline - kSpinTime;
+        if (Clock::now() < sleepUntil) {
+            std::this_thread::sleep_until(sleepUntil);
+        }
+        while (Clock::now() < _deadline) {
+            std::this_thread::yield();
+        }
+
+        _deadline += _period;
+        // More than a frame late: drop the missed deadlines
+        const auto now = Clock::now();
+        if (_deadline < now) {
+            _deadline = now + _period;
+        }
+    }
+
+    const auto now = Clock::now();
+    if (_started) {
+        const double frameTimeMs = std::chrono::duration<double, std::milli>(now - _frame_start).count();
+        const double workTimeMs = std::chrono::duration<double, std::milli>(workEnd - _frame_start).count();
+        if (_frame_times_ms.size() < kFrameTimeWindow) {
+            _frame_times_ms.emplace_back(frameTimeMs);
+            _work_times_ms.emplace_back(workTimeMs);
+        } else {
+            _frame_times_ms[_next_frame_time] = frameTimeMs;
+            _work_times_ms[_next_frame_time] = workTimeMs;
+        }
+        _next_frame_time = (_next_frame_time + 1) % kFrameTimeWindow;
+    }
+    _frame_start = now;
+    _started = true;
+}
+
+void FrameScheduler::resume() {
+    _frame_start = Clock::now();
+    _deadline = _frame_start + _period;
+    _started = true;
+}
+
+FrameTimeStats FrameScheduler::stats() const {
+    return frameTimeStats(_frame_times_ms);
+}
+
+FrameTimeStats FrameScheduler::workStats() const {
+    return frameTimeStats(_work_times_ms);
+}
+
+}
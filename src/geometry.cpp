@@ -0,0 +1,123 @@
+#include "geometry.h"
+
+#include "spankernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMPLEGL_X86_KERNELS 1
+#endif
+
+// Built with -ffp-contract=off like the span kernels: every level computes
+// ((m0*x + m1*y) + m2*z) + m3 with separately rounded operations.
+
+namespace
+{
+
+using simplegl::mat4_t;
+using simplegl::scalar_t;
+
+struct Input {
+    scalar_t const* x;
+    scalar_t const* y;
+    scalar_t const* z;
+};
+
+struct Output {
+    scalar_t* row[4];
+};
+
+void transformScalar(mat4_t const & matrix, Input in, Output out, size_t begin, size_t count) {
+    for (size_t i = begin; i < count; ++i) {
+        for (int r = 0; r < 4; ++r) {
+            out.row[r][i] = matrix.m[r][0]*in.x[i] + matrix.m[r][1]*in.y[i] + matrix.m[r][2]*in.z[i] + matrix.m[r][3];
+        }
+    }
+}
+
+#ifdef SIMPLEGL_X86_KERNELS
+
+// Generic vectors of Bytes/sizeof(scalar_t) lanes, the same code serves float
+// and double. Loads and stores go through memcpy, the arrays are unaligned.
+template <size_t Bytes>
+struct Lanes {
+    typedef scalar_t type __attribute__((vector_size(Bytes)));
+};
+
+template <size_t Bytes>
+inline __attribute__((always_inline)) void transformLanes(mat4_t const & matrix, Input in, Output out, size_t i) {
+    using Vector = typename Lanes<Bytes>::type;
+    Vector x, y, z;
+    std::memcpy(&x, in.x + i, Bytes);
+    std::memcpy(&y, in.y + i, Bytes);
+    std::memcpy(&z, in.z + i, Bytes);
+    for (int r = 0; r < 4; ++r) {
+        const Vector value = matrix.m[r][0]*x + matrix.m[r][1]*y + matrix.m[r][2]*z + matrix.m[r][3];
+        std::memcpy(out.row[r] + i, &value, Bytes);
+    }
+}
+
+void transformSSE2(mat4_t const & matrix, Input in, Output out, size_t count) {
+    constexpr size_t lanes = 16/sizeof(scalar_t);
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        transformLanes<16>(matrix, in, out, i);
+    }
+    transformScalar(matrix, in, out, i, count);
+}
+
+__attribute__((target("avx2")))
+void transformAVX2(mat4_t const & matrix, Input in, Output out, size_t count) {
+    constexpr size_t lanes = 32/sizeof(scalar_t);
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        transformLanes<32>(matrix, in, out, i);
+    }
+    transformScalar(matrix, in, out, i, count);
+}
+
+#endif
+
+}
+
+namespace simplegl
+{
+
+PositionArrays toPositionArrays(std::span<vec3_t const> positions) {
+    PositionArrays result;
+    result.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        result.x[i] = positions[i].x;
+        result.y[i] = positions[i].y;
+        result.z[i] = positions[i].z;
+    }
+    return result;
+}
+
+void transformPositions(mat4_t const & matrix, PositionArrays const & positions, ClipPositionArrays & transformed) {
+    transformed.resize(positions.size());
+    transformPositions(matrix, positions, 0, positions.size(), transformed);
+}
+
+void transformPositions(mat4_t const & matrix, PositionArrays const & positions, size_t first, size_t count, ClipPositionArrays & transformed) {
+
+    const Input in = {positions.x.data() + first, positions.y.data() + first, positions.z.data() + first};
+    const Output out = {{transformed.x.data() + first, transformed.y.data() + first, transformed.z.data() + first, transformed.w.data() + first}};
+
+    switch (spanKernels().level) {
+#ifdef SIMPLEGL_X86_KERNELS
+    case SimdLevel::AVX512:
+    case SimdLevel::AVX2:
+        transformAVX2(matrix, in, out, count);
+        return;
+    case SimdLevel::SSE2:
+        transformSSE2(matrix, in, out, count);
+        return;
+#endif
+    default:
+        transformScalar(matrix, in, out, 0, count);
+        return;
+    }
+}
+
+}
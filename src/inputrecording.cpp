@@ -0,0 +1,164 @@
+#include "inputrecording.h"
+
+#include <array>
+#include <charconv>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+constexpr std::string_view kHeader = "simplegl-input 1";
+
+constexpr std::array<std::string_view, 8> kActionNames = {
+    "rotate-x-up",
+    "rotate-x-down",
+    "rotate-y-left",
+    "rotate-y-right",
+    "zoom-in",
+    "zoom-out",
+    "toggle-depth",
+    "toggle-fill"
+};
+
+char const * onOff(bool value) {
+    return value ? "on" : "off";
+}
+
+// Parses "on" or "off" into value.
+bool parseOnOff(std::string const & text, bool & value) {
+    if (text != "on" && text != "off") {
+        return false;
+    }
+    value = text == "on";
+    return true;
+}
+
+// Parses a whole decimal field, failing on anything that does not fit.
+bool parseCount(std::string const & text, uint32_t & value) {
+    char const * last = text.data() + text.size();
+    auto result = std::from_chars(text.data(), last, value);
+    return result.ec == std::errc{} && result.ptr == last && !text.empty();
+}
+
+}
+
+namespace simplegl
+{
+
+std::string_view toString(InputAction action) {
+    return kActionNames[static_cast<size_t>(action)];
+}
+
+std::optional<InputAction> inputActionFromString(std::string_view name) {
+    for (size_t i = 0; i < kActionNames.size(); ++i) {
+        if (kActionNames[i] == name) {
+            return static_cast<InputAction>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<InputRecorder> InputRecorder::Create(std::string const & path, SessionOptions const & options) {
+    InputRecorder result;
+    result._file.open(path);
+    if (!result._file) {
+        std::cerr << "Cannot write the input recording " << path << '\n';
+        return std::nullopt;
+    }
+
+    result._file << kHeader << '\n'
+                 << "mesh " << options.meshPath << '\n'
+                 << "fill " << (options.fillMode == FillMode::EdgeFunction ? "edge" : "scanline") << '\n'
+                 << "depth " << onOff(options.depthTest) << '\n'
+                 << "weld " << onOff(options.weld) << '\n'
+                 << "lod " << onOff(options.lod) << '\n'
+                 << "meshlets " << onOff(options.meshlets) << '\n'
+                 << "wireframe " << (options.edgeWireframe ? "edges" : "triangles") << '\n';
+    result._file.flush();
+    return result;
+}
+
+void InputRecorder::record(uint32_t frame, InputAction action) {
+    if (_last_frame != UINT32_MAX && frame != _last_frame) {
+        _file.flush();
+    }
+    _last_frame = frame;
+    _file << frame << ' ' << toString(action) << '\n';
+}
+
+void InputRecorder::finish(uint32_t frames) {
+    _file << "frames " << frames << '\n';
+    _file.flush();
+}
+
+std::optional<InputRecording> loadInputRecording(std::string const & path, SessionOptions const & defaults) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot read the input recording " << path << '\n';
+        return std::nullopt;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kHeader) {
+        std::cerr << path << " is not an input recording\n";
+        return std::nullopt;
+    }
+
+    InputRecording result;
+    result.options = defaults;
+    bool hasFrames = false;
+    for (int lineNumber = 2; std::getline(file, line); ++lineNumber) {
+        if (line.empty()) continue;
+
+        std::istringstream fields(line);
+        std::string first;
+        std::string second;
+        fields >> first >> second;
+
+        bool valid = !second.empty();
+        if (first == "mesh") {
+            // The rest of the line, the path may hold spaces
+            if (valid) {
+                result.options.meshPath = line.substr(line.find_first_not_of(' ', first.size()));
+            }
+        } else if (first == "fill") {
+            valid = valid && (second == "edge" || second == "scanline");
+            result.options.fillMode = second == "edge" ? FillMode::EdgeFunction : FillMode::Scanline;
+        } else if (first == "depth") {
+            valid = valid && parseOnOff(second, result.options.depthTest);
+        } else if (first == "weld") {
+            valid = valid && parseOnOff(second, result.options.weld);
+        } else if (first == "lod") {
+            valid = valid && parseOnOff(second, result.options.lod);
+        } else if (first == "meshlets") {
+            valid = valid && parseOnOff(second, result.options.meshlets);
+        } else if (first == "wireframe") {
+            valid = valid && (second == "edges" || second == "triangles");
+            result.options.edgeWireframe = second == "edges";
+        } else if (first == "frames") {
+            valid = valid && parseCount(second, result.frames);
+            hasFrames = valid;
+        } else {
+            const auto action = inputActionFromString(second);
+            uint32_t frame = 0;
+            valid = valid && action && parseCount(first, frame);
+            if (valid) {
+                valid = result.events.empty() || result.events.back().frame <= frame;
+                result.events.emplace_back(InputEvent{frame, *action});
+            }
+        }
+
+        if (!valid) {
+            std::cerr << path << ':' << lineNumber << ": cannot parse \"" << line << "\"\n";
+            return std::nullopt;
+        }
+    }
+
+    if (!hasFrames) {
+        result.frames = result.events.empty() ? 1 : result.events.back().frame + 1;
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,430 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <queue>
+#include <utility>
+
+#include "vertexcache.h"
+
+namespace
+{
+
+using simplegl::vec3d_t;
+
+// Boundary edges are held in place by a plane through them, perpendicular to
+// their face, weighted this much more than the surface planes.
+constexpr double kBoundaryWeight = 1000.0;
+
+// Symmetric 4x4 error matrix of the planes around a vertex, upper triangle.
+// error(p) is the weighted sum of squared distances from p to the planes.
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+
+    // Plane dot(normal, p) + d = 0, normal of unit length
+    static Quadric plane(vec3d_t const & normal, double d, double weight) {
+        Quadric q;
+        q.a00 = weight*normal.x*normal.x;
+        q.a01 = weight*normal.x*normal.y;
+        q.a02 = weight*normal.x*normal.z;
+        q.a03 = weight*normal.x*d;
+        q.a11 = weight*normal.y*normal.y;
+        q.a12 = weight*normal.y*normal.z;
+        q.a13 = weight*normal.y*d;
+        q.a22 = weight*normal.z*normal.z;
+        q.a23 = weight*normal.z*d;
+        q.a33 = weight*d*d;
+        return q;
+    }
+
+    Quadric& operator+=(Quadric const & other) {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+        a11 += other.a11; a12 += other.a12; a13 += other.a13;
+        a22 += other.a22; a23 += other.a23;
+        a33 += other.a33;
+        return *this;
+    }
+
+    double error(vec3d_t const & p) const {
+        const double e =
+            a00*p.x*p.x + 2*a01*p.x*p.y + 2*a02*p.x*p.z + 2*a03*p.x +
+            a11*p.y*p.y + 2*a12*p.y*p.z + 2*a13*p.y +
+            a22*p.z*p.z + 2*a23*p.z +
+            a33;
+        return std::max(e, 0.0);
+    }
+
+    // Position of least error, none when the planes do not pin one down
+    std::optional<vec3d_t> minimum() const {
+        const double c00 = a11*a22 - a12*a12;
+        const double c01 = a02*a12 - a01*a22;
+        const double c02 = a01*a12 - a02*a11;
+        const double det = a00*c00 + a01*c01 + a02*c02;
+        const double trace = a00 + a11 + a22;
+        if (!(std::abs(det) > 1e-9*trace*trace*trace)) {
+            return std::nullopt;
+        }
+        const double c11 = a00*a22 - a02*a02;
+        const double c12 = a01*a02 - a00*a12;
+        const double c22 = a00*a11 - a01*a01;
+        return vec3d_t{
+            -(c00*a03 + c01*a13 + c02*a23)/det,
+            -(c01*a03 + c11*a13 + c12*a23)/det,
+            -(c02*a03 + c12*a13 + c22*a23)/det
+        };
+    }
+};
+
+struct Collapse {
+    double cost = 0.0;
+    int kept = 0;
+    int removed = 0;
+    uint32_t keptStamp = 0;
+    uint32_t removedStamp = 0;
+    vec3d_t position;
+
+    bool operator>(Collapse const & other) const {
+        return cost > other.cost;
+    }
+};
+
+class Simplifier {
+
+public:
+
+    explicit Simplifier(simplegl::Mesh const & mesh) {
+        const auto vertices = mesh.vertices();
+        _positions.reserve(vertices.size());
+        for (auto const & vertex : vertices) {
+            _positions.emplace_back(simplegl::vecCast<double>(vertex));
+        }
+        _quadrics.resize(_positions.size());
+        _vertex_faces.resize(_positions.size());
+        _stamps.resize(_positions.size());
+        _alive_vertexes.assign(_positions.size(), 1);
+
+        for (auto const & face : mesh.faces()) {
+            std::array<int, 3> corners;
+            bool valid = true;
+            for (int i = 0; i < 3; ++i) {
+                corners[i] = face.indexes[i].vertex;
+                valid = valid && corners[i] >= 0 && static_cast<size_t>(corners[i]) < _positions.size();
+            }
+            if (valid && corners[0] != corners[1] && corners[1] != corners[2] && corners[2] != corners[0]) {
+                _faces.emplace_back(corners);
+            }
+        }
+        _alive_faces.assign(_faces.size(), 1);
+        _live_face_count = _faces.size();
+
+        for (uint32_t face = 0; face < _faces.size(); ++face) {
+            for (int corner : _faces[face]) {
+                _vertex_faces[corner].emplace_back(face);
+            }
+        }
+
+        addPlaneQuadrics();
+        queueEdges();
+    }
+
+    void simplify(size_t targetFaces) {
+        while (_live_face_count > targetFaces && !_queue.empty()) {
+            const Collapse collapse = _queue.top();
+            _queue.pop();
+
+            if (!_alive_vertexes[collapse.kept] || !_alive_vertexes[collapse.removed] ||
+                _stamps[collapse.kept] != collapse.keptStamp || _stamps[collapse.removed] != collapse.removedStamp) {
+                continue;
+            }
+            if (!collapseAllowed(collapse)) {
+                continue;
+            }
+            apply(collapse);
+        }
+    }
+
+    simplegl::Mesh result() const {
+        std::vector<int> remap(_positions.size(), simplegl::kNoIndex);
+        std::vector<simplegl::vec3_t> vertexes;
+        std::vector<simplegl::Face> faces;
+        faces.reserve(_live_face_count);
+
+        for (uint32_t face = 0; face < _faces.size(); ++face) {
+            if (!_alive_faces[face]) continue;
+            simplegl::Face output;
+            for (int i = 0; i < 3; ++i) {
+                const int corner = _faces[face][i];
+                if (remap[corner] == simplegl::kNoIndex) {
+                    remap[corner] = static_cast<int>(vertexes.size());
+                    vertexes.emplace_back(simplegl::vecCast<simplegl::scalar_t>(_positions[corner]));
+                }
+                output.indexes[i] = {remap[corner], simplegl::kNoIndex, simplegl::kNoIndex};
+            }
+            faces.emplace_back(output);
+        }
+        return simplegl::Mesh(std::move(vertexes), {}, {}, std::move(faces));
+    }
+
+private:
+
+    vec3d_t faceNormal(std::array<int, 3> const & face) const {
+        return cross(_positions[face[1]] - _positions[face[0]], _positions[face[2]] - _positions[face[0]]);
+    }
+
+    void addPlaneQuadrics() {
+        // Edge (low, high vertex) -> faces, to find the boundary edges
+        std::vector<std::array<uint32_t, 3>> edges;
+        edges.reserve(_faces.size()*3);
+
+        for (uint32_t face = 0; face < _faces.size(); ++face) {
+            for (int i = 0; i < 3; ++i) {
+                const int a = _faces[face][i];
+                const int b = _faces[face][(i + 1) % 3];
+                edges.push_back({static_cast<uint32_t>(std::min(a, b)), static_cast<uint32_t>(std::max(a, b)), face});
+            }
+
+            const vec3d_t normal = faceNormal(_faces[face]);
+            const double doubleArea = length(normal);
+            if (doubleArea == 0.0) continue;
+
+            // Weighted by area, so slivers barely constrain their vertexes
+            const vec3d_t unit = normal/doubleArea;
+            const Quadric quadric = Quadric::plane(unit, -dot(unit, _positions[_faces[face][0]]), doubleArea*0.5);
+            for (int corner : _faces[face]) {
+                _quadrics[corner] += quadric;
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size(); ++i) {
+            const bool shared =
+                (i > 0 && edges[i - 1][0] == edges[i][0] && edges[i - 1][1] == edges[i][1]) ||
+                (i + 1 < edges.size() && edges[i + 1][0] == edges[i][0] && edges[i + 1][1] == edges[i][1]);
+            if (shared) continue;
+
+            const int a = static_cast<int>(edges[i][0]);
+            const int b = static_cast<int>(edges[i][1]);
+            const vec3d_t direction = _positions[b] - _positions[a];
+            const vec3d_t perpendicular = cross(direction, faceNormal(_faces[edges[i][2]]));
+            const double perpendicularLength = length(perpendicular);
+            if (perpendicularLength == 0.0) continue;
+
+            const vec3d_t unit = perpendicular/perpendicularLength;
+            const Quadric quadric = Quadric::plane(unit, -dot(unit, _positions[a]), kBoundaryWeight*dot(direction, direction));
+            _quadrics[a] += quadric;
+            _quadrics[b] += quadric;
+        }
+    }
+
+    void queueEdges() {
+        for (auto const & face : _faces) {
+            for (int i = 0; i < 3; ++i) {
+                const int a = face[i];
+                const int b = face[(i + 1) % 3];
+                // Interior edges are seen twice, once per direction
+                if (a < b || !hasEdge(b, a)) {
+                    queueCollapse(a, b);
+                }
+            }
+        }
+    }
+
+    // Whether a live face has the directed edge a -> b
+    bool hasEdge(int a, int b) const {
+        for (uint32_t face : _vertex_faces[a]) {
+            if (!_alive_faces[face]) continue;
+            auto const & corners = _faces[face];
+            for (int i = 0; i < 3; ++i) {
+                if (corners[i] == a && corners[(i + 1) % 3] == b) return true;
+            }
+        }
+        return false;
+    }
+
+    void queueCollapse(int a, int b) {
+        Quadric quadric = _quadrics[a];
+        quadric += _quadrics[b];
+
+        Collapse collapse;
+        collapse.kept = a;
+        collapse.removed = b;
+        collapse.keptStamp = _stamps[a];
+        collapse.removedStamp = _stamps[b];
+
+        if (auto minimum = quadric.minimum()) {
+            collapse.position = *minimum;
+            collapse.cost = quadric.error(*minimum);
+        } else {
+            // Flat or straight neighborhood: the best of the ends and the middle
+            collapse.position = _positions[a];
+            collapse.cost = quadric.error(_positions[a]);
+            for (vec3d_t const & candidate : {_positions[b], (_positions[a] + _positions[b])*0.5}) {
+                const double cost = quadric.error(candidate);
+                if (cost < collapse.cost) {
+                    collapse.cost = cost;
+                    collapse.position = candidate;
+                }
+            }
+        }
+        _queue.push(collapse);
+    }
+
+    void liveNeighbors(int vertex, std::vector<int> & neighbors) const {
+        neighbors.clear();
+        for (uint32_t face : _vertex_faces[vertex]) {
+            if (!_alive_faces[face]) continue;
+            for (int corner : _faces[face]) {
+                if (corner != vertex) neighbors.emplace_back(corner);
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    }
+
+    bool collapseAllowed(Collapse const & collapse) {
+        // Link condition: the ends may only share the neighbors opposite
+        // the edge, otherwise the collapse pinches the surface
+        liveNeighbors(collapse.kept, _kept_neighbors);
+        liveNeighbors(collapse.removed, _removed_neighbors);
+        _common_neighbors.clear();
+        std::set_intersection(
+            _kept_neighbors.begin(), _kept_neighbors.end(),
+            _removed_neighbors.begin(), _removed_neighbors.end(),
+            std::back_inserter(_common_neighbors));
+
+        int sharedFaces = 0;
+        for (uint32_t face : _vertex_faces[collapse.kept]) {
+            if (_alive_faces[face] && std::ranges::find(_faces[face], collapse.removed) != _faces[face].end()) {
+                ++sharedFaces;
+            }
+        }
+        if (static_cast<int>(_common_neighbors.size()) > sharedFaces) {
+            return false;
+        }
+
+        // No surviving face around either end may flip
+        for (int end : {collapse.kept, collapse.removed}) {
+            for (uint32_t face : _vertex_faces[end]) {
+                if (!_alive_faces[face]) continue;
+                auto const & corners = _faces[face];
+                if (std::ranges::find(corners, collapse.kept) != corners.end() &&
+                    std::ranges::find(corners, collapse.removed) != corners.end()) {
+                    continue;
+                }
+
+                const vec3d_t before = faceNormal(corners);
+                const vec3d_t saved = _positions[end];
+                _positions[end] = collapse.position;
+                const vec3d_t after = faceNormal(corners);
+                _positions[end] = saved;
+
+                if (dot(before, after) <= 0.0) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void apply(Collapse const & collapse) {
+        const int kept = collapse.kept;
+        const int removed = collapse.removed;
+
+        _positions[kept] = collapse.position;
+        _quadrics[kept] += _quadrics[removed];
+        _alive_vertexes[removed] = 0;
+        ++_stamps[kept];
+        ++_stamps[removed];
+
+        for (uint32_t face : _vertex_faces[removed]) {
+            if (!_alive_faces[face]) continue;
+            auto & corners = _faces[face];
+            if (std::ranges::find(corners, kept) != corners.end()) {
+                _alive_faces[face] = 0;
+                --_live_face_count;
+                continue;
+            }
+            std::ranges::replace(corners, removed, kept);
+            _vertex_faces[kept].emplace_back(face);
+        }
+        _vertex_faces[removed].clear();
+
+        auto & keptFaces = _vertex_faces[kept];
+        std::erase_if(keptFaces, [this](uint32_t face) { return !_alive_faces[face]; });
+
+        liveNeighbors(kept, _kept_neighbors);
+        for (int neighbor : _kept_neighbors) {
+            queueCollapse(kept, neighbor);
+        }
+    }
+
+    std::vector<vec3d_t> _positions;
+    std::vector<Quadric> _quadrics;
+    std::vector<std::array<int, 3>> _faces;
+    std::vector<uint8_t> _alive_faces;
+    std::vector<uint8_t> _alive_vertexes;
+    // Bumped whenever a vertex moves or dies, queued collapses remember it
+    std::vector<uint32_t> _stamps;
+    std::vector<std::vector<uint32_t>> _vertex_faces;
+    size_t _live_face_count = 0;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> _queue;
+
+    // Scratch space of collapseAllowed() and apply()
+    std::vector<int> _kept_neighbors;
+    std::vector<int> _removed_neighbors;
+    std::vector<int> _common_neighbors;
+
+};
+
+}
+
+namespace simplegl
+{
+
+Mesh simplifyMesh(Mesh const & mesh, size_t targetFaces) {
+    Simplifier simplifier(mesh);
+    simplifier.simplify(targetFaces);
+    return simplifier.result();
+}
+
+LodChain::LodChain(Mesh mesh, unsigned simplifiedLevels) {
+
+    for (auto const & vertex : mesh.vertices()) {
+        _bounding_radius = std::max(_bounding_radius, length(vecCast<double>(vertex)));
+    }
+
+    _levels.emplace_back(std::move(mesh));
+
+    while (_levels.size() <= simplifiedLevels && _levels.back().faces().size() > kMinLodFaces) {
+        const size_t faces = _levels.back().faces().size();
+        const size_t target = std::max(static_cast<size_t>(faces*kLodRatio), kMinLodFaces);
+        Mesh simplified = simplifyMesh(_levels.back(), target);
+
+        // Stalled: most collapses were refused, another level is no cheaper
+        if (simplified.faces().size() > faces - (faces - target)/2) {
+            break;
+        }
+        _levels.emplace_back(optimizeVertexCache(simplified));
+    }
+}
+
+size_t LodChain::select(double projectedArea) const {
+    // About half the faces face the camera, spread over the projected area
+    const double budget = 2.0*projectedArea/kLodPixelsPerTriangle;
+    for (size_t index = 0; index < _levels.size(); ++index) {
+        if (static_cast<double>(_levels[index].faces().size()) <= budget) {
+            return index;
+        }
+    }
+    return _levels.size() - 1;
+}
+
+}
@@ -1,10 +1,31 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
 #include <numbers>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
 
+#include "adjacency.h"
+#include "framebuffer.h"
+#include "framepipeline.h"
+#include "clipping.h"
+#include "framescheduler.h"
+#include "geometry.h"
+#include "inputrecording.h"
+#include "lod.h"
+#include "meshlet.h"
 #include "objloader.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "spankernels.h"
+#include "tiledrenderer.h"
+#include "vertexcache.h"
 #include "window.h"
 #include "vec.h"
 
@@ -12,11 +33,12 @@ namespace
 {
 
 constexpr double fovFactor = 640.0;
-constexpr unsigned targetFps = 60;
-constexpr auto targetFpsTime = std::chrono::milliseconds(1000/targetFps);
+constexpr double nearPlane = 0.1;
+constexpr double farPlane = 100.0;
+constexpr double cameraDistance = 5.0;
+constexpr double meshScale = 0.25;
 constexpr int windowWidth = 1920; // max: 3840
 constexpr int windowHeight = 1080; // max: 2160
-constexpr int widhtDividedBy2 = windowWidth/2;
 constexpr int heightDividedBy2 = windowHeight/2;
 constexpr uint32_t colorBlue = 0xFF0000FF;
 constexpr uint32_t colorGreen = 0xFF00FF00;
@@ -32,187 +54,853 @@ int zoomIndex = 0;
 double rotationX = 0;
 double rotationY = 0;
 double zoom = 1.0;
-std::array<simplegl::vec3_t,3> transformedVertices = {};
+simplegl::FillMode fillMode = simplegl::FillMode::EdgeFunction;
+bool depthTest = true;
+// Set by processInput() when the window system lost the window contents
+bool windowExposed = false;
+simplegl::RasterStats rasterStats;
+std::unique_ptr<simplegl::TiledRenderer> tiledRenderer;
+// Whether the last frame was drawn into the locked texture, which leaves the
+// framebuffer's own color and depth buffers stale
+bool drewIntoTexture = false;
+// Mesh vertices in clip space, transformed once per frame. Only update()
+// uses it, which runs on one thread at a time.
+simplegl::ClipPositionArrays clipVertices;
+// Whether each face of the LOD level reached the screen this frame, for the
+// edge wireframe. Only update() uses it.
+std::vector<uint8_t> facesDrawn;
+
+// Everything a frame depends on besides the mesh. The window loop only draws
+// a new frame when this differs from the one on screen.
+struct ViewState {
+    double rotationX = 0.0;
+    double rotationY = 0.0;
+    double zoom = 0.0;
+    simplegl::FillMode fillMode = simplegl::FillMode::EdgeFunction;
+    bool depthTest = true;
+
+    bool operator==(ViewState const &) const = default;
+};
+
+ViewState viewState() {
+    return {rotationX, rotationY, zoom, fillMode, depthTest};
+}
+
+void applyInput(simplegl::InputAction action) {
+    switch (action) {
+    case simplegl::InputAction::RotateXUp:
+        rotationXIndex++;
+        rotationX = rotationStep*rotationXIndex;
+        break;
+    case simplegl::InputAction::RotateXDown:
+        rotationXIndex--;
+        rotationX = rotationStep*rotationXIndex;
+        break;
+    case simplegl::InputAction::RotateYLeft:
+        rotationYIndex++;
+        rotationY = rotationStep*rotationYIndex;
+        break;
+    case simplegl::InputAction::RotateYRight:
+        rotationYIndex--;
+        rotationY = rotationStep*rotationYIndex;
+        break;
+    case simplegl::InputAction::ZoomIn:
+        zoomIndex++;
+        zoom = defaultZoom + zoomIndex*zoomStep;
+        break;
+    case simplegl::InputAction::ZoomOut:
+        zoomIndex--;
+        zoom = defaultZoom + zoomIndex*zoomStep;
+        if (zoom < zoomStep) zoom = zoomStep;
+        break;
+    case simplegl::InputAction::ToggleDepthTest:
+        depthTest = !depthTest;
+        break;
+    case simplegl::InputAction::ToggleFillMode:
+        fillMode = fillMode == simplegl::FillMode::EdgeFunction ?
+            simplegl::FillMode::Scanline :
+            simplegl::FillMode::EdgeFunction;
+        break;
+    }
+}
+
+struct FrameStats {
+    size_t lodLevel = 0;
+    size_t trianglesRendered = 0;
+    // Faces reaching the per triangle tests, and culled as back facing
+    unsigned trianglesIn = 0;
+    unsigned trianglesBackFacing = 0;
+    // Faces outside the frustum, and cut by clipping
+    unsigned trianglesOutside = 0;
+    unsigned trianglesClipped = 0;
+    // Meshlets culled whole, and the vertexes transformed
+    unsigned meshletsCulled = 0;
+    size_t vertexesTransformed = 0;
+    size_t linesRendered = 0;
+};
+
+// What update() produces for one view and render() draws. Frames are reused,
+// the vectors keep their capacity from one frame to the next.
+struct Frame {
+    ViewState view;
+    // Screen space triangles, pixel coordinates with the inverse view depth in z
+    std::vector<simplegl::vec3_t> vertexes;
+    // Mesh edges of each triangle in vertexes, see clipTriangle()
+    std::vector<uint8_t> edgeMasks;
+    // With --wireframe edges, every visible mesh edge once, two vertexes per
+    // line, in the same space as vertexes
+    std::vector<simplegl::vec3_t> lines;
+    FrameStats stats;
+};
+
+struct Options {
+    std::string meshPath = "../objects/teapot.obj";
+    int headlessFrames = 0;
+    std::string ppmPath;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool meshCache = true;
+    bool weld = false;
+    bool lod = true;
+    bool meshlets = true;
+    bool edgeWireframe = true;
+    double fps = 60.0;
+    bool vsync = false;
+    bool pipeline = false;
+    bool lockTexture = true;
+    std::string tracePath;
+    std::string recordPath;
+    std::string replayPath;
+};
+
+Options options;
+// Vertex counts of the loaded mesh around welding, when --weld is on
+std::optional<simplegl::WeldStats> weldStats;
+// Logs the window session's input, when --record is given
+std::optional<simplegl::InputRecorder> inputRecorder;
+
+// The loader reports why a mesh cannot be loaded
+std::optional<simplegl::Mesh> loadMesh() {
+    // The cached mesh is stored with its faces already reordered
+    auto opt = options.meshCache ?
+        simplegl::ObjLoader::loadCached(options.meshPath, options.threads) :
+        simplegl::ObjLoader::load(options.meshPath, options.threads);
+    if (!opt) {
+        return std::nullopt;
+    }
+    if (!options.meshCache) {
+        opt = simplegl::optimizeVertexCache(*opt);
+    }
+    if (options.weld) {
+        weldStats = opt->weld();
+    }
+    return opt;
+    // return simplegl::Mesh::buildCylinder(10);
+    // return simplegl::Mesh::buildSphere(5);
+}
 
-std::vector<simplegl::vec2_t> vertexesToRender;
-simplegl::vec3_t camera_position = {0.0, 0.0, 0.0};
+// Set by loadLodChain() before the first frame
+std::optional<simplegl::LodChain> lodChain;
 
+bool loadLodChain() {
+    auto mesh = loadMesh();
+    if (!mesh) {
+        return false;
+    }
+    lodChain.emplace(std::move(*mesh), options.lod ? simplegl::kMaxLodLevels : 0);
+    return true;
+}
+
+simplegl::LodChain const & getLodChain() {
+    assert(lodChain.has_value());
+    return *lodChain;
+}
+
+// The mesh as loaded, level 0 of the LOD chain
 simplegl::Mesh const & getMeshToRender() {
-    static simplegl::Mesh const meshToRender = [](){
-        auto opt = simplegl::ObjLoader::load("../objects/teapot.obj");
-        assert(opt.has_value());
-        return opt.value();
-        // return simplegl::Mesh::buildCylinder(10);
-        // return simplegl::Mesh::buildSphere(5);
-    }();
-    return meshToRender;
+    return getLodChain().level(0);
 }
 
 }
 
-void processInput(bool& keep_runing) {
+std::optional<simplegl::InputAction> inputAction(SDL_Keycode key) {
+    switch (key) {
+    case SDLK_UP: return simplegl::InputAction::RotateXUp;
+    case SDLK_DOWN: return simplegl::InputAction::RotateXDown;
+    case SDLK_RIGHT: return simplegl::InputAction::RotateYRight;
+    case SDLK_LEFT: return simplegl::InputAction::RotateYLeft;
+    case SDLK_i: return simplegl::InputAction::ZoomIn;
+    case SDLK_o: return simplegl::InputAction::ZoomOut;
+    case SDLK_z: return simplegl::InputAction::ToggleDepthTest;
+    case SDLK_f: return simplegl::InputAction::ToggleFillMode;
+    default: return std::nullopt;
+    }
+}
+
+// frame is the window loop iteration, for the input recording
+void processInput(bool& keep_runing, uint32_t frame) {
+    SIMPLEGL_ZONE("processInput");
     SDL_Event event;
     while(SDL_PollEvent(&event)) {
         switch(event.type) {
         case SDL_QUIT:
             keep_runing = false;
             break;
+        case SDL_WINDOWEVENT:
+            if (event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_RESTORED) {
+                windowExposed = true;
+            }
+            break;
         case SDL_KEYDOWN:
             if(event.key.keysym.sym == SDLK_ESCAPE) {
                 keep_runing = false;
             }
-            else if(event.key.keysym.sym == SDLK_UP) {
-                rotationXIndex++;
-                rotationX = rotationStep*rotationXIndex;
-            }
-            else if(event.key.keysym.sym == SDLK_DOWN) {
-                rotationXIndex--;
-                rotationX = rotationStep*rotationXIndex;
-            }
-            else if(event.key.keysym.sym == SDLK_RIGHT) {
-                rotationYIndex--;
-                rotationY = rotationStep*rotationYIndex;
-            }
-            else if(event.key.keysym.sym == SDLK_LEFT) {
-                rotationYIndex++;
-                rotationY = rotationStep*rotationYIndex;
-            }
-            else if(event.key.keysym.sym == SDLK_i) {
-                zoomIndex++;
-                zoom = defaultZoom + zoomIndex*zoomStep;
-            }
-            else if(event.key.keysym.sym == SDLK_o) {
-                zoomIndex--;
-                zoom = defaultZoom + zoomIndex*zoomStep;
-                if (zoom < zoomStep) zoom = zoomStep;
+            else if (const auto action = inputAction(event.key.keysym.sym)) {
+                applyInput(*action);
+                if (inputRecorder) {
+                    inputRecorder->record(frame, *action);
+                }
             }
             break;
         }
     }
 }
 
-simplegl::vec2_t project(simplegl::vec3_t const& point) {
-    simplegl::vec2_t projected_point = {(fovFactor * point.x)/point.z,(fovFactor * point.y)/point.z};
-    return projected_point;
+// Blocks until the window system has an event, for a loop with nothing to
+// draw. The event is left for processInput().
+void waitForInput() {
+    SIMPLEGL_ZONE("waitForInput");
+    SDL_WaitEvent(nullptr);
 }
 
-simplegl::vec3_t translate(simplegl::vec3_t const& point, double factor_x, double factor_y, double factor_z) {
-    simplegl::vec3_t projected_point = {point.x + factor_x, point.y + factor_y, point.z + factor_z};
-    return projected_point;
+simplegl::PositionArrays const & getMeshPositions(size_t lodLevel) {
+    static std::vector<simplegl::PositionArrays> const meshPositions = [](){
+        std::vector<simplegl::PositionArrays> positions;
+        for (size_t level = 0; level < getLodChain().levelCount(); ++level) {
+            positions.emplace_back(simplegl::toPositionArrays(getLodChain().level(level).vertices()));
+        }
+        return positions;
+    }();
+    return meshPositions[lodLevel];
 }
 
-simplegl::vec3_t scale(simplegl::vec3_t const& point, double factor_x, double factor_y, double factor_z) {
-    simplegl::vec3_t projected_point = {point.x*factor_x, point.y*factor_y, point.z*factor_z};
-    return projected_point;
+simplegl::MeshletMesh const & getMeshlets(size_t lodLevel) {
+    static std::vector<simplegl::MeshletMesh> const meshlets = [](){
+        std::vector<simplegl::MeshletMesh> result;
+        for (size_t level = 0; level < getLodChain().levelCount(); ++level) {
+            result.emplace_back(simplegl::buildMeshlets(getLodChain().level(level)));
+        }
+        return result;
+    }();
+    return meshlets[lodLevel];
 }
 
-simplegl::vec3_t scale(simplegl::vec3_t const& point, double factor) {
-    simplegl::vec3_t projected_point = {point.x*factor, point.y*factor, point.z*factor};
-    return projected_point;
+// Face neighbors of every LOD level, with faces numbered in the order
+// update() walks them: meshlet triangles with --meshlets on, mesh faces
+// otherwise.
+std::vector<simplegl::FaceNeighbors> const & getFaceNeighbors(size_t lodLevel) {
+    static std::vector<std::vector<simplegl::FaceNeighbors>> const neighbors = [](){
+        std::vector<std::vector<simplegl::FaceNeighbors>> result;
+        for (size_t level = 0; level < getLodChain().levelCount(); ++level) {
+            result.emplace_back(options.meshlets ?
+                simplegl::buildFaceNeighbors(getMeshlets(level)) :
+                simplegl::buildFaceNeighbors(getLodChain().level(level)));
+        }
+        return result;
+    }();
+    return neighbors[lodLevel];
 }
 
-simplegl::vec3_t rotateX(simplegl::vec3_t const& point, double angle) {
-    simplegl::vec3_t projected_point = {point.x, std::sin(-angle)*point.z + std::cos(-angle)*point.y, std::cos(-angle)*point.z - std::sin(-angle)*point.y};
-    return projected_point;
+// Projection straight to pixels: clip x/w and y/w are framebuffer
+// coordinates and clip w is the view depth.
+simplegl::mat4d_t const & screenProjection() {
+    static simplegl::mat4d_t const projection =
+        simplegl::mat4d_t::viewport(windowWidth, windowHeight) *
+        simplegl::mat4d_t::perspective(2.0*std::atan(heightDividedBy2/fovFactor), double(windowWidth)/windowHeight, nearPlane, farPlane);
+    return projection;
 }
 
-simplegl::vec3_t rotateY(simplegl::vec3_t const& point, double angle) {
-    simplegl::vec3_t projected_point = {std::sin(angle)*point.z + std::cos(angle)*point.x, point.y, std::cos(angle)*point.z - std::sin(angle)*point.x};
-    return projected_point;
+// Clips to the near plane, and to the sides only beyond a guard band well
+// within the rasterizer's fixed point range.
+simplegl::ClipVolume const & clipVolume() {
+    static simplegl::ClipVolume const volume = {
+        windowWidth,
+        windowHeight,
+        nearPlane,
+        farPlane,
+        simplegl::kMaxRasterCoordinate/2
+    };
+    return volume;
 }
 
-simplegl::vec3_t rotateZ(simplegl::vec3_t const& point, double angle) {
-    simplegl::vec3_t projected_point = {std::cos(angle)*point.x - std::sin(angle)*point.y, std::sin(angle)*point.x + std::cos(angle)*point.y, point.z};
-    return projected_point;
+// Pixels covered by the bounding sphere of the mesh, at most the window.
+double projectedMeshArea(double zoom) {
+    const double radius = getLodChain().boundingRadius()*zoom*meshScale;
+    if (radius >= cameraDistance - nearPlane) {
+        return double(windowWidth)*windowHeight;
+    }
+    const double pixels = fovFactor*radius/std::sqrt(cameraDistance*cameraDistance - radius*radius);
+    return std::min(std::numbers::pi*pixels*pixels, double(windowWidth)*windowHeight);
 }
 
-void update() {
-    vertexesToRender.clear();
+// Culls the clip space triangle abc if back facing, otherwise clips it into
+// the frame. With --wireframe edges, also appends the edges of the face that
+// no earlier drawn face has, taken from the triangle just appended when it
+// needed no clipping and clipped on their own otherwise.
+void addTriangle(simplegl::vec4_t const & a, simplegl::vec4_t const & b, simplegl::vec4_t const & c, uint32_t face, Frame & frame) {
+    ++frame.stats.trianglesIn;
 
-    simplegl::Mesh const & meshToRender = getMeshToRender();
-
-    for (unsigned int faceIdx = 0; faceIdx < meshToRender.faces().size(); ++faceIdx) {
-        simplegl::Face const & face = meshToRender.faces()[faceIdx];
+    if (simplegl::backFacing(a, b, c)) {
+        ++frame.stats.trianglesBackFacing;
+        return;
+    }
 
-        for (unsigned int i = 0; i < 3; ++i) {
-            simplegl::vec3_t vertex = meshToRender.vertices()[face.indexes[i].vertex];
+    const simplegl::ClipResult result = simplegl::clipTriangle(clipVolume(), a, b, c, frame.vertexes, frame.edgeMasks);
+    switch (result) {
+    case simplegl::ClipResult::Rejected: ++frame.stats.trianglesOutside; return;
+    case simplegl::ClipResult::Clipped: ++frame.stats.trianglesClipped; break;
+    case simplegl::ClipResult::Inside: break;
+    }
 
-            vertex = rotateX(vertex, rotationX);
-            vertex = rotateY(vertex, rotationY);
-            vertex = scale(vertex, zoom*0.25);
+    if (!options.edgeWireframe) {
+        return;
+    }
+    facesDrawn[face] = 1;
+
+    simplegl::FaceNeighbors const & neighbors = getFaceNeighbors(frame.stats.lodLevel)[face];
+    simplegl::vec4_t const * corners[] = {&a, &b, &c};
+    for (int edge = 0; edge < 3; ++edge) {
+        const uint32_t neighbor = neighbors[edge];
+        if (neighbor < face && facesDrawn[neighbor]) continue;
+
+        if (result == simplegl::ClipResult::Inside) {
+            const size_t first = frame.vertexes.size() - 3;
+            frame.lines.emplace_back(frame.vertexes[first + edge]);
+            frame.lines.emplace_back(frame.vertexes[first + (edge + 1) % 3]);
+        } else {
+            simplegl::clipLine(clipVolume(), *corners[edge], *corners[(edge + 1) % 3], frame.lines);
+        }
+    }
+}
 
-            // Put camera at distance 5 from the origin
-            vertex = translate(vertex, 0.0, 0.0, 5.0);
+// Transforms every vertex of the LOD level, then culls and clips every face.
+void transformMesh(simplegl::mat4_t const & transform, Frame & frame) {
+    SIMPLEGL_ZONE("transformMesh");
+    simplegl::Mesh const & meshToRender = getLodChain().level(frame.stats.lodLevel);
+    simplegl::transformPositions(transform, getMeshPositions(frame.stats.lodLevel), clipVertices);
+    frame.stats.vertexesTransformed = clipVertices.size();
+
+    auto const & faces = meshToRender.faces();
+    facesDrawn.assign(faces.size(), 0);
+    for (size_t i = 0; i < faces.size(); ++i) {
+        addTriangle(
+            clipVertices.at(faces[i].indexes[0].vertex),
+            clipVertices.at(faces[i].indexes[1].vertex),
+            clipVertices.at(faces[i].indexes[2].vertex),
+            static_cast<uint32_t>(i),
+            frame);
+    }
+}
 
-            transformedVertices[i] = vertex;
-        }
-        
-        // Face culling
-        simplegl::vec3_t ab = transformedVertices[1] - transformedVertices[0];
-        simplegl::vec3_t ac = transformedVertices[2] - transformedVertices[0];
-        simplegl::vec3_t normal = simplegl::cross(ab, ac).normalize();
-        simplegl::vec3_t triangleCamera = (camera_position - transformedVertices[0]).normalize();
-        auto dotProduct = simplegl::dot(normal, triangleCamera);
-        if (dotProduct < 0.0) {
+// Whole meshlets off screen or facing away are skipped before any of their
+// vertexes is transformed.
+void transformMeshlets(simplegl::mat4d_t const & modelView, simplegl::mat4d_t const & modelViewProjection, simplegl::mat4_t const & transform, Frame & frame) {
+    SIMPLEGL_ZONE("transformMeshlets");
+    simplegl::MeshletMesh const & meshlets = getMeshlets(frame.stats.lodLevel);
+    const auto viewToModel = simplegl::inverse(modelView);
+    assert(viewToModel.has_value());
+    const simplegl::vec4d_t eye = *viewToModel*simplegl::vec4d_t{0.0, 0.0, 0.0, 1.0};
+    const simplegl::MeshletCuller culler(clipVolume(), modelViewProjection, {eye.x, eye.y, eye.z});
+
+    clipVertices.resize(meshlets.positions.size());
+
+    // Vertexes owned by visible meshlets are transformed by range. Those
+    // shared with a culled owner are transformed one at a time, once.
+    static std::vector<uint8_t> meshletVisible;
+    static std::vector<uint8_t> vertexTransformed;
+    meshletVisible.resize(meshlets.meshlets.size());
+    vertexTransformed.assign(meshlets.positions.size(), 0);
+    facesDrawn.assign(meshlets.triangles.size()/3, 0);
+
+    for (size_t m = 0; m < meshlets.meshlets.size(); ++m) {
+        simplegl::Meshlet const & meshlet = meshlets.meshlets[m];
+        meshletVisible[m] = culler.visible(meshlet);
+        if (!meshletVisible[m]) {
+            ++frame.stats.meshletsCulled;
             continue;
         }
-        
-        for (simplegl::vec3_t const & transformedVertex : transformedVertices) {
-            auto vertexToRender = project(transformedVertex);
-            vertexToRender.x += widhtDividedBy2;
-            vertexToRender.y += heightDividedBy2;
-            vertexesToRender.emplace_back(vertexToRender);
+        simplegl::transformPositions(transform, meshlets.positions, meshlet.firstOwnedVertex, meshlet.ownedVertexCount, clipVertices);
+        frame.stats.vertexesTransformed += meshlet.ownedVertexCount;
+    }
+
+    for (size_t m = 0; m < meshlets.meshlets.size(); ++m) {
+        if (!meshletVisible[m]) continue;
+        simplegl::Meshlet const & meshlet = meshlets.meshlets[m];
+        uint32_t const * vertexes = &meshlets.vertexes[meshlet.vertexOffset];
+
+        for (uint32_t v = 0; v < meshlet.vertexCount; ++v) {
+            const uint32_t vertex = vertexes[v];
+            if (!meshletVisible[meshlets.owners[vertex]] && !vertexTransformed[vertex]) {
+                simplegl::transformPositions(transform, meshlets.positions, vertex, 1, clipVertices);
+                vertexTransformed[vertex] = 1;
+                ++frame.stats.vertexesTransformed;
+            }
         }
 
+        uint8_t const * triangle = &meshlets.triangles[3*meshlet.triangleOffset];
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t, triangle += 3) {
+            addTriangle(
+                clipVertices.at(vertexes[triangle[0]]),
+                clipVertices.at(vertexes[triangle[1]]),
+                clipVertices.at(vertexes[triangle[2]]),
+                meshlet.triangleOffset + t,
+                frame);
+        }
     }
+}
 
+void update(ViewState const & view, Frame & frame) {
+    SIMPLEGL_ZONE("update");
+    frame.view = view;
+    frame.vertexes.clear();
+    frame.edgeMasks.clear();
+    frame.lines.clear();
+    frame.stats = {};
+    frame.stats.lodLevel = getLodChain().select(projectedMeshArea(view.zoom));
+
+    // Put camera at distance 5 from the origin. Composed in double, only the
+    // per vertex work runs at the pipeline precision.
+    const simplegl::mat4d_t modelView =
+        simplegl::mat4d_t::translation({0.0, 0.0, cameraDistance}) *
+        simplegl::mat4d_t::scale(view.zoom*meshScale) *
+        simplegl::mat4d_t::rotationY(view.rotationY) *
+        simplegl::mat4d_t::rotationX(view.rotationX);
+    const simplegl::mat4d_t modelViewProjection = screenProjection()*modelView;
+    const simplegl::mat4_t transform = simplegl::matCast<simplegl::scalar_t>(modelViewProjection);
+
+    if (options.meshlets) {
+        transformMeshlets(modelView, modelViewProjection, transform, frame);
+    } else {
+        transformMesh(transform, frame);
+    }
+    frame.stats.trianglesRendered = frame.vertexes.size()/3;
+    frame.stats.linesRendered = frame.lines.size()/2;
+
+    SIMPLEGL_COUNTER("triangles in", frame.stats.trianglesIn);
+    SIMPLEGL_COUNTER("triangles back facing", frame.stats.trianglesBackFacing);
+    SIMPLEGL_COUNTER("triangles outside", frame.stats.trianglesOutside);
+    SIMPLEGL_COUNTER("meshlets culled", frame.stats.meshletsCulled);
+    SIMPLEGL_COUNTER("vertexes transformed", static_cast<int64_t>(frame.stats.vertexesTransformed));
 }
 
-void render(simplegl::Window & window) {
+void setupBackground(simplegl::Framebuffer & framebuffer) {
+    framebuffer.clearColorBuffer(0xFF000000);
+    framebuffer.drawGrid(12);
+    framebuffer.captureBackground();
+}
 
-    window.drawGrid(12);
+// Samples the raster counters of the frame just drawn
+void countRasterStats() {
+    SIMPLEGL_COUNTER("triangles rasterized", static_cast<int64_t>(rasterStats.triangles));
+    SIMPLEGL_COUNTER("pixels written", static_cast<int64_t>(rasterStats.pixelsWritten + rasterStats.pixelsFilled));
+}
 
-    for (unsigned i = 0; i < vertexesToRender.size(); i+=3) {
-        window.fillTriangle(
-            vertexesToRender[i].x,
-            vertexesToRender[i].y,
-            vertexesToRender[i + 1].x,
-            vertexesToRender[i + 1].y,
-            vertexesToRender[i + 2].x,
-            vertexesToRender[i + 2].y,
-            colorWhite);
+// Expects the framebuffer to hold the background already, except when tiled:
+// the tiles restore it themselves, in parallel, just before drawing.
+void render(Frame const & frame, simplegl::Framebuffer & framebuffer) {
+    SIMPLEGL_ZONE("render");
+
+    if (tiledRenderer) {
+        simplegl::RenderJob job;
+        job.restoreBackground = true;
+        job.vertexes = &frame.vertexes;
+        job.edgeMasks = &frame.edgeMasks;
+        job.lines = options.edgeWireframe ? &frame.lines : nullptr;
+        job.fillMode = frame.view.fillMode;
+        job.depthTest = frame.view.depthTest;
+        job.fillColor = colorWhite;
+        job.wireColor = colorGray;
+        tiledRenderer->render(framebuffer, job);
+        rasterStats = tiledRenderer->stats();
+        countRasterStats();
+        return;
     }
+
+    rasterStats = {};
+
+    {
+        SIMPLEGL_ZONE("fill");
+        for (unsigned i = 0; i < frame.vertexes.size(); i+=3) {
+            simplegl::fillTriangle(
+                framebuffer,
+                frame.vertexes[i],
+                frame.vertexes[i + 1],
+                frame.vertexes[i + 2],
+                colorWhite,
+                framebuffer.bounds(),
+                frame.view.fillMode,
+                frame.view.depthTest,
+                rasterStats);
+        }
+    }
+
+    const bool depthTestedWireframe = frame.view.depthTest && frame.view.fillMode == simplegl::FillMode::EdgeFunction;
     
-    for (unsigned i = 0; i < vertexesToRender.size(); i+=3) {
-        window.drawTriangle(
-            vertexesToRender[i].x,
-            vertexesToRender[i].y,
-            vertexesToRender[i + 1].x,
-            vertexesToRender[i + 1].y,
-            vertexesToRender[i + 2].x,
-            vertexesToRender[i + 2].y,
-            colorGray);
-    }
-
-    // for (unsigned i = 0; i < vertexesToRender.size(); ++i) {
-    //     window.drawRectangle(vertexesToRender[i].x - 2 , vertexesToRender[i].y - 2, 5, 5, colorYellow);
+    if (options.edgeWireframe) {
+        SIMPLEGL_ZONE("wireframe");
+        for (size_t i = 0; i + 1 < frame.lines.size(); i += 2) {
+            simplegl::vec3_t const & a = frame.lines[i];
+            simplegl::vec3_t const & b = frame.lines[i + 1];
+            if (depthTestedWireframe) {
+                framebuffer.drawLine(a, b, colorGray, framebuffer.bounds());
+            } else {
+                framebuffer.drawLine(simplegl::vec2_t{a.x, a.y}, simplegl::vec2_t{b.x, b.y}, colorGray, framebuffer.bounds());
+            }
+        }
+    } else {
+        SIMPLEGL_ZONE("wireframe");
+        for (unsigned i = 0; i < frame.vertexes.size(); i+=3) {
+            if (depthTestedWireframe) {
+                framebuffer.drawTriangle(
+                    frame.vertexes[i],
+                    frame.vertexes[i + 1],
+                    frame.vertexes[i + 2],
+                    colorGray,
+                    framebuffer.bounds(),
+                    frame.edgeMasks[i/3]);
+                continue;
+            }
+
+            framebuffer.drawTriangle(
+                simplegl::vec2_t{frame.vertexes[i].x, frame.vertexes[i].y},
+                simplegl::vec2_t{frame.vertexes[i + 1].x, frame.vertexes[i + 1].y},
+                simplegl::vec2_t{frame.vertexes[i + 2].x, frame.vertexes[i + 2].y},
+                colorGray,
+                framebuffer.bounds(),
+                frame.edgeMasks[i/3]);
+        }
+    }
+
+    countRasterStats();
+
+    // for (unsigned i = 0; i < frame.vertexes.size(); ++i) {
+    //     framebuffer.drawRectangle(frame.vertexes[i].x - 2 , frame.vertexes[i].y - 2, 5, 5, colorYellow);
     // }
+}
 
-    window.renderColorBuffer();
-    window.clearColorBuffer(0xFF000000);
+void present(simplegl::Window & window, simplegl::Framebuffer & framebuffer) {
+    SIMPLEGL_ZONE("present");
+    if (tiledRenderer) {
+        window.renderColorBuffer(framebuffer);
+    } else {
+        window.renderColorBufferAndRestore(framebuffer);
+    }
     window.renderPresent();
 }
 
-void waitFrameTime(std::chrono::system_clock::time_point start_time_point, std::chrono::milliseconds target_fps_time) {
-    auto processing_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start_time_point);
-        if (processing_time < target_fps_time) {
-            auto remaining_time = target_fps_time - processing_time;
-            std::this_thread::sleep_for(remaining_time);
+// Renders the frame and presents it. With --upload lock the frame is drawn
+// straight into the locked streaming texture; otherwise, or when the texture
+// cannot be locked, into the framebuffer and then copied to the texture.
+void renderAndPresent(Frame const & frame, simplegl::Window & window, simplegl::Framebuffer & framebuffer) {
+    if (!options.lockTexture || !window.lockColorBuffer(framebuffer)) {
+        if (drewIntoTexture && !tiledRenderer) {
+            framebuffer.restoreBackground();
+        }
+        drewIntoTexture = false;
+        render(frame, framebuffer);
+        present(window, framebuffer);
+        return;
+    }
+    drewIntoTexture = true;
+
+    // The locked pixels hold no background, tiles restore their own
+    if (!tiledRenderer) {
+        framebuffer.restoreBackground();
+    }
+    render(frame, framebuffer);
+
+    SIMPLEGL_ZONE("present");
+    window.unlockColorBuffer(framebuffer);
+    window.renderPresent();
+}
+
+// Writes the recorded zones and counters when --trace is given.
+bool writeTrace() {
+#ifdef SIMPLEGL_PROFILE
+    if (!options.tracePath.empty()) {
+        simplegl::profile::setRecording(false);
+        return simplegl::profile::writeChromeTrace(options.tracePath);
+    }
+#endif
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--obj" && hasValue) {
+            options.meshPath = argv[++i];
+        } else if (arg == "--headless" && hasValue) {
+            options.headlessFrames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--ppm" && hasValue) {
+            options.ppmPath = argv[++i];
+        } else if (arg == "--fill" && hasValue && (argv[i + 1] == std::string_view{"edge"} || argv[i + 1] == std::string_view{"scanline"})) {
+            fillMode = argv[++i] == std::string_view{"edge"} ?
+                simplegl::FillMode::EdgeFunction :
+                simplegl::FillMode::Scanline;
+        } else if (arg == "--simd" && hasValue && simplegl::simdLevelFromString(argv[i + 1])) {
+            if (!simplegl::selectSpanKernels(*simplegl::simdLevelFromString(argv[++i]))) {
+                std::cerr << argv[i] << " is not supported by this CPU\n";
+                return false;
+            }
+        } else if (arg == "--depth" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            depthTest = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--mesh-cache" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            options.meshCache = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--weld" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            options.weld = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--lod" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            options.lod = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--meshlets" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            options.meshlets = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--wireframe" && hasValue && (argv[i + 1] == std::string_view{"edges"} || argv[i + 1] == std::string_view{"triangles"})) {
+            options.edgeWireframe = argv[++i] == std::string_view{"edges"};
+        } else if (arg == "--fps" && hasValue) {
+            options.fps = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--vsync" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            options.vsync = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--pipeline" && hasValue && (argv[i + 1] == std::string_view{"on"} || argv[i + 1] == std::string_view{"off"})) {
+            options.pipeline = argv[++i] == std::string_view{"on"};
+        } else if (arg == "--upload" && hasValue && (argv[i + 1] == std::string_view{"lock"} || argv[i + 1] == std::string_view{"copy"})) {
+            options.lockTexture = argv[++i] == std::string_view{"lock"};
+        } else if (arg == "--trace" && hasValue) {
+#ifdef SIMPLEGL_PROFILE
+            options.tracePath = argv[++i];
+#else
+            std::cerr << "--trace needs a build with SIMPLEGL_PROFILE\n";
+            return false;
+#endif
+        } else if (arg == "--record" && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--obj <path>] [--headless <frames>] [--ppm <path>] [--fill edge|scanline] [--depth on|off] [--threads <count>] [--simd scalar|sse2|avx2|avx512] [--mesh-cache on|off] [--weld on|off] [--lod on|off] [--meshlets on|off] [--wireframe edges|triangles] [--fps <rate>] [--vsync on|off] [--pipeline on|off] [--upload lock|copy] [--trace <path>] [--record <path>] [--replay <path>]\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// The options a recorded session depends on, as currently set
+simplegl::SessionOptions sessionOptions() {
+    simplegl::SessionOptions result;
+    result.meshPath = options.meshPath;
+    result.fillMode = fillMode;
+    result.depthTest = depthTest;
+    result.weld = options.weld;
+    result.lod = options.lod;
+    result.meshlets = options.meshlets;
+    result.edgeWireframe = options.edgeWireframe;
+    return result;
+}
+
+// The view of every headless frame: the command line view, or with --replay
+// the camera path of the recorded session, one view per window loop iteration.
+std::optional<std::vector<ViewState>> headlessViews() {
+    if (options.replayPath.empty()) {
+        return std::vector<ViewState>(options.headlessFrames, viewState());
+    }
+
+    const auto recording = simplegl::loadInputRecording(options.replayPath, sessionOptions());
+    if (!recording) {
+        return std::nullopt;
+    }
+    // The recorded scene, whatever the command line asked for
+    options.meshPath = recording->options.meshPath;
+    fillMode = recording->options.fillMode;
+    depthTest = recording->options.depthTest;
+    options.weld = recording->options.weld;
+    options.lod = recording->options.lod;
+    options.meshlets = recording->options.meshlets;
+    options.edgeWireframe = recording->options.edgeWireframe;
+
+    std::vector<ViewState> views;
+    views.reserve(recording->frames);
+    auto event = recording->events.begin();
+    for (uint32_t frame = 0; frame < recording->frames; ++frame) {
+        for (; event != recording->events.end() && event->frame == frame; ++event) {
+            applyInput(event->action);
+        }
+        views.emplace_back(viewState());
+    }
+    return views;
+}
+
+// Renders the headless frames into an offscreen framebuffer without touching
+// SDL, as fast as they go, and reports the per-frame CPU time (clear + update
+// + render). A replay also lists every frame.
+int runHeadless() {
+    const auto views = headlessViews();
+    if (!views) {
+        return 1;
+    }
+    const int frameCount = static_cast<int>(views->size());
+
+    simplegl::Framebuffer framebuffer(windowWidth, windowHeight);
+    setupBackground(framebuffer);
+    std::vector<double> frameTimesMs;
+    frameTimesMs.reserve(frameCount);
+    std::vector<FrameStats> replayStats;
+
+    auto load_start_time_point = std::chrono::steady_clock::now();
+    if (!loadLodChain()) {
+        return 1;
+    }
+    if (options.meshlets) {
+        getMeshlets(0);
+    }
+    if (options.edgeWireframe) {
+        getFaceNeighbors(0);
+    }
+    std::chrono::duration<double, std::milli> load_time = std::chrono::steady_clock::now() - load_start_time_point;
+
+    // Frame times run from one finished frame to the next, which for the
+    // pipeline is its throughput
+    FrameStats lastStats;
+    auto frame_end_time_point = std::chrono::steady_clock::now();
+    auto draw = [&](Frame const & frame) {
+        if (!tiledRenderer) {
+            framebuffer.restoreBackground();
+        }
+        render(frame, framebuffer);
+        lastStats = frame.stats;
+        if (!options.replayPath.empty()) {
+            replayStats.emplace_back(frame.stats);
         }
+        const auto now = std::chrono::steady_clock::now();
+        frameTimesMs.emplace_back(std::chrono::duration<double, std::milli>(now - frame_end_time_point).count());
+        frame_end_time_point = now;
+    };
+
+    if (options.pipeline) {
+        simplegl::FramePipeline<Frame> frames;
+        std::thread producer([&frames, &views](){
+#ifdef SIMPLEGL_PROFILE
+            simplegl::profile::setThreadName("update");
+#endif
+            for (ViewState const & view : *views) {
+                update(view, *frames.acquireWrite());
+                frames.publish();
+            }
+        });
+        for (int frame = 0; frame < frameCount; ++frame) {
+            draw(*frames.acquireRead());
+            frames.release();
+        }
+        producer.join();
+    } else {
+        Frame frame;
+        for (ViewState const & view : *views) {
+            update(view, frame);
+            draw(frame);
+        }
+    }
+
+    if (!options.ppmPath.empty() && !framebuffer.writePPM(options.ppmPath)) {
+        return 1;
+    }
+    if (!writeTrace()) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < replayStats.size(); ++i) {
+        std::cout << "frame " << i << ": " << frameTimesMs[i] << " ms, "
+                  << replayStats[i].trianglesRendered << " triangles rendered, LOD level " << replayStats[i].lodLevel << ", "
+                  << replayStats[i].vertexesTransformed << " vertexes transformed\n";
+    }
+
+    double totalMs = 0.0;
+    for (double ms : frameTimesMs) totalMs += ms;
+    std::sort(frameTimesMs.begin(), frameTimesMs.end());
+
+    std::cout << options.meshPath << ": " << getMeshToRender().faces().size() << " faces loaded in " << load_time.count() << " ms, "
+              << lastStats.trianglesRendered << " triangles rendered ("
+              << lastStats.trianglesOutside << " outside the frustum, " << lastStats.trianglesClipped << " clipped), "
+              << (options.edgeWireframe ? std::to_string(lastStats.linesRendered) + " wireframe edges, " : "")
+              << windowWidth << "x" << windowHeight << ", "
+              << options.threads << " threads, "
+              << (options.pipeline ? "pipelined, " : "")
+              << simplegl::toString(simplegl::spanKernels().level) << " kernels\n";
+
+    if (weldStats) {
+        std::cout << "welded: " << weldStats->vertexesBefore << " -> " << weldStats->vertexesAfter << " vertexes, "
+                  << weldStats->textureUVsBefore << " -> " << weldStats->textureUVsAfter << " texture UVs, "
+                  << weldStats->normalsBefore << " -> " << weldStats->normalsAfter << " normals\n";
+    }
+
+    const simplegl::VertexCacheStats vertexCache = simplegl::measureVertexCache(getMeshToRender().faces());
+    std::cout << "LOD level " << lastStats.lodLevel << " of " << getLodChain().levelCount() << ":";
+    for (size_t level = 0; level < getLodChain().levelCount(); ++level) {
+        std::cout << ' ' << getLodChain().level(level).faces().size();
+    }
+    std::cout << " faces\n";
+
+    if (options.meshlets) {
+        std::cout << "meshlets: " << lastStats.meshletsCulled << " of " << getMeshlets(lastStats.lodLevel).meshlets.size() << " culled, "
+                  << lastStats.vertexesTransformed << " of " << getMeshlets(lastStats.lodLevel).positions.size() << " vertexes transformed\n";
+    } else {
+        std::cout << "vertexes transformed: " << lastStats.vertexesTransformed << '\n';
+    }
+
+    std::cout << "vertex cache (" << simplegl::kVertexCacheSize << " entries): ACMR " << vertexCache.acmr << ", ATVR " << vertexCache.atvr << '\n';
+
+    const simplegl::FrameTimeStats percentiles = simplegl::frameTimeStats(frameTimesMs);
+    std::cout << frameTimesMs.size() << " frames, ms/frame"
+              << " min " << frameTimesMs.front()
+              << " mean " << totalMs/frameTimesMs.size()
+              << " median " << frameTimesMs[frameTimesMs.size()/2]
+              << " p95 " << percentiles.p95Ms
+              << " p99 " << percentiles.p99Ms
+              << " max " << frameTimesMs.back() << '\n';
+
+    if (depthTest && fillMode == simplegl::FillMode::EdgeFunction) {
+        std::cout << "last frame: " << rasterStats.triangles << " triangles, "
+                  << rasterStats.trianglesRejected << " rejected by hi-z, "
+                  << rasterStats.blocksRejected << " blocks rejected by hi-z, "
+                  << rasterStats.pixelsTested << " pixels depth tested, "
+                  << rasterStats.pixelsTested - rasterStats.pixelsWritten << " rejected\n";
+    }
+    return 0;
 }
 
-int main() {
-    auto window_opt = simplegl::Window::Create(windowWidth, windowHeight);
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        return 1;
+    }
+
+#ifdef SIMPLEGL_PROFILE
+    simplegl::profile::setThreadName("main");
+    simplegl::profile::setRecording(!options.tracePath.empty());
+#endif
+
+    // A single thread draws straight into the framebuffer, binning would only add work
+    if (options.threads > 1) {
+        tiledRenderer = std::make_unique<simplegl::TiledRenderer>(windowWidth, windowHeight, options.threads);
+    }
+
+    if (options.headlessFrames > 0 || !options.replayPath.empty()) {
+        return runHeadless();
+    }
+
+    if (!loadLodChain()) {
+        return 1;
+    }
+
+    auto window_opt = simplegl::Window::Create(windowWidth, windowHeight, options.vsync);
     bool keep_running = window_opt.has_value();
 
     if (!keep_running) {
@@ -221,15 +909,111 @@ int main() {
 
     auto& window = *window_opt;
     window.setupDrawingBuffer();
+    simplegl::Framebuffer framebuffer(windowWidth, windowHeight);
+    setupBackground(framebuffer);
+    simplegl::FrameScheduler scheduler(options.fps);
+    if (!options.recordPath.empty()) {
+        inputRecorder = simplegl::InputRecorder::Create(options.recordPath, sessionOptions());
+        if (!inputRecorder) {
+            return 1;
+        }
+    }
+
+    // Pipelined, views go to the update thread and its frames come back; the
+    // render of one frame overlaps the update of the next.
+    simplegl::FramePipeline<ViewState, 1> views;
+    simplegl::FramePipeline<Frame> frames;
+    std::thread producer;
+    if (options.pipeline) {
+        producer = std::thread([&views, &frames](){
+#ifdef SIMPLEGL_PROFILE
+            simplegl::profile::setThreadName("update");
+#endif
+            while (ViewState const * requested = views.acquireRead()) {
+                const ViewState view = *requested;
+                views.release();
+                Frame * frame = frames.acquireWrite();
+                if (!frame) break;
+                update(view, *frame);
+                frames.publish();
+            }
+        });
+    }
+    Frame frame;
+
+    // View of the frame on screen or on its way there, none before the first one
+    std::optional<ViewState> requestedView;
+    // Views sent to the update thread whose frame was not presented yet
+    unsigned framesInFlight = 0;
+    uint32_t frameIndex = 0;
 
     while(keep_running)
     {
-        auto start_time_point = std::chrono::system_clock::now();
-        processInput(keep_running);
-        update();
-        render(window);
-        waitFrameTime(start_time_point, targetFpsTime);
+        processInput(keep_running, frameIndex++);
+        const ViewState view = viewState();
+        bool presented = false;
+
+        if (options.pipeline) {
+            if (view != requestedView) {
+                if (ViewState * slot = views.tryAcquireWrite()) {
+                    *slot = view;
+                    views.publish();
+                    requestedView = view;
+                    ++framesInFlight;
+                }
+            }
+            if (Frame const * ready = frames.tryAcquireRead()) {
+                renderAndPresent(*ready, window, framebuffer);
+                frames.release();
+                --framesInFlight;
+                presented = true;
+            }
+        } else if (view != requestedView) {
+            update(view, frame);
+            renderAndPresent(frame, window, framebuffer);
+            requestedView = view;
+            presented = true;
+        }
+
+        if (!presented && windowExposed) {
+            // The texture still holds the last frame
+            window.renderColorBufferTexture();
+            window.renderPresent();
+        }
+        windowExposed = false;
+
+        // Nothing changed and nothing on its way: sleep until the next
+        // input instead of pacing empty frames
+        if (!presented && framesInFlight == 0 && view == requestedView) {
+            waitForInput();
+            scheduler.resume();
+        } else {
+            scheduler.waitNextFrame();
+        }
     }
-    
+
+    if (producer.joinable()) {
+        views.close();
+        frames.close();
+        producer.join();
+    }
+    if (inputRecorder) {
+        inputRecorder->finish(frameIndex);
+    }
+    if (!writeTrace()) {
+        return 1;
+    }
+
+    const simplegl::FrameTimeStats frameTimes = scheduler.stats();
+    const simplegl::FrameTimeStats workTimes = scheduler.workStats();
+    std::cout << "last " << frameTimes.frames << " frames, ms/frame"
+              << " p50 " << frameTimes.p50Ms
+              << " p95 " << frameTimes.p95Ms
+              << " p99 " << frameTimes.p99Ms
+              << ", work ms/frame"
+              << " p50 " << workTimes.p50Ms
+              << " p95 " << workTimes.p95Ms
+              << " p99 " << workTimes.p99Ms << '\n';
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,91 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#define SIMPLEGL_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace simplegl
+{
+
+std::optional<MappedFile> MappedFile::open(std::string_view path) {
+    const std::string pathString{path};
+
+#ifdef SIMPLEGL_HAS_MMAP
+    const int fd = ::open(pathString.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open " << path << '\n';
+        return std::nullopt;
+    }
+
+    struct stat info;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (data != MAP_FAILED) {
+        madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        MappedFile file;
+        file._data = static_cast<char const *>(data);
+        file._size = static_cast<size_t>(info.st_size);
+        file._mapped = true;
+        return file;
+    }
+#endif
+
+    std::ifstream ifs{pathString, std::ios::binary};
+    if (!ifs) {
+        std::cerr << "Could not open " << path << '\n';
+        return std::nullopt;
+    }
+
+    MappedFile file;
+    file._buffer.assign(std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{});
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile && other) :
+_data{std::exchange(other._data, nullptr)},
+_size{std::exchange(other._size, 0)},
+_mapped{std::exchange(other._mapped, false)},
+_buffer{std::move(other._buffer)} {
+}
+
+MappedFile& MappedFile::operator=(MappedFile && other) {
+    if (this != &other) {
+        unmap();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _mapped = std::exchange(other._mapped, false);
+        _buffer = std::move(other._buffer);
+    }
+    return *this;
+}
+
+void MappedFile::unmap() {
+#ifdef SIMPLEGL_HAS_MMAP
+    if (_mapped) {
+        munmap(const_cast<char*>(_data), _size);
+    }
+#endif
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
+
+}
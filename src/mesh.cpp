@@ -1,18 +1,93 @@
 #include "mesh.h"
 
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <numbers>
+#include <unordered_map>
+#include <utility>
 
 namespace
 {
 
 simplegl::vec3_t getPointFromUV(double u, double v) {
     const double cosU = std::cos(u);
-    return simplegl::vec3_t{
+    return simplegl::vecCast<simplegl::scalar_t>(simplegl::vec3d_t{
         cosU*std::cos(v),
         std::sin(u),
-        cosU*std::sin(v)};
+        cosU*std::sin(v)});
 }
 
+template <int N>
+struct CellHash {
+    size_t operator()(std::array<int64_t, N> const & cell) const {
+        uint64_t hash = 0;
+        for (int64_t coordinate : cell) {
+            hash = (hash ^ static_cast<uint64_t>(coordinate))*0x9E3779B97F4A7C15ull;
+        }
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+// Merged index of every old index, assigned in the order faces use them.
+template <typename T, int N>
+class Welder {
+
+public:
+
+    Welder(std::span<simplegl::vec<T, N> const> values, double tolerance) :
+    _values{values},
+    _scale{1.0/tolerance},
+    _remap(values.size(), kUnvisited) {
+    }
+
+    // Out of range indexes, kNoIndex included, become kNoIndex
+    int operator()(int index) {
+        if (index < 0 || static_cast<size_t>(index) >= _values.size()) {
+            return simplegl::kNoIndex;
+        }
+        int & merged = _remap[index];
+        if (merged == kUnvisited) {
+            merged = mergedIndex(_values[index]);
+        }
+        return merged;
+    }
+
+    std::vector<simplegl::vec<T, N>> release() {
+        return std::move(_merged);
+    }
+
+private:
+
+    static constexpr int kUnvisited = -2;
+
+    int mergedIndex(simplegl::vec<T, N> const & value) {
+        std::array<int64_t, N> cell;
+        for (int i = 0; i < N; ++i) {
+            const double snapped = std::round(value[i]*_scale);
+            // NaN, infinities and cells beyond int64 are never merged
+            if (!(std::abs(snapped) < 0x1p62)) {
+                _merged.emplace_back(value);
+                return static_cast<int>(_merged.size() - 1);
+            }
+            cell[i] = static_cast<int64_t>(snapped);
+        }
+
+        auto [it, inserted] = _cells.try_emplace(cell, static_cast<int>(_merged.size()));
+        if (inserted) {
+            _merged.emplace_back(value);
+        }
+        return it->second;
+    }
+
+    std::span<simplegl::vec<T, N> const> _values;
+    double _scale = 1.0;
+    std::vector<int> _remap;
+    std::vector<simplegl::vec<T, N>> _merged;
+    std::unordered_map<std::array<int64_t, N>, int, CellHash<N>> _cells;
+
+};
+
 }
 
 namespace simplegl
@@ -20,6 +95,13 @@ namespace simplegl
 
 const int kNoIndex = -1;
 
+Mesh::Mesh(std::vector<vec3_t> vertexes, std::vector<vec2_t> textureUVs, std::vector<vec3_t> normals, std::vector<Face> faces) :
+_vertexes{std::move(vertexes)},
+_textureUVs{std::move(textureUVs)},
+_normals{std::move(normals)},
+_faces{std::move(faces)} {
+}
+
 Mesh Mesh::buildSphere(unsigned int geometryLevel)
 {
     auto result = simplegl::Mesh();
@@ -62,6 +144,7 @@ Mesh Mesh::buildSphere(unsigned int geometryLevel)
             previousV = v;
         }
 
+    result.weld();
     return result;
 }
 
@@ -71,10 +154,10 @@ Mesh Mesh::buildCylinder(unsigned int geometryLevel)
 
     if (geometryLevel < 3) geometryLevel = 3;
 
-    constexpr double x0 = 1.0; //cos(0)
-    constexpr double z0 = 0.0; //sin(0)
+    constexpr scalar_t x0 = 1.0; //cos(0)
+    constexpr scalar_t z0 = 0.0; //sin(0)
     
-    const double cylinderSize = std::sqrt(2)/2;
+    const scalar_t cylinderSize = std::sqrt(scalar_t{2})/2;
     const double step = (std::numbers::pi*2.0)/geometryLevel;
     const auto upOrigin = simplegl::vec3_t{0.0, cylinderSize, 0.0};
     const auto downOrigin = simplegl::vec3_t{0.0, -cylinderSize, 0.0};
@@ -86,8 +169,8 @@ Mesh Mesh::buildCylinder(unsigned int geometryLevel)
 
         const double u = i*step;
 
-        const double x1 = std::cos(u);
-        const double z1 = std::sin(u);
+        const scalar_t x1 = std::cos(u);
+        const scalar_t z1 = std::sin(u);
 
         const auto up1 = simplegl::vec3_t{x1, cylinderSize, z1};
         const auto down1 = simplegl::vec3_t{x1, -cylinderSize, z1};
@@ -101,26 +184,95 @@ Mesh Mesh::buildCylinder(unsigned int geometryLevel)
         down0 = down1;
 
     }
+    result.weld();
+    return result;
+}
+
+Mesh Mesh::view(std::shared_ptr<void const> owner, std::span<vec3_t const> vertexes, std::span<vec2_t const> textureUVs, std::span<vec3_t const> normals, std::span<Face const> faces) {
+    Mesh result;
+    result._external = std::make_shared<External const>(External{std::move(owner), vertexes, textureUVs, normals, faces});
     return result;
 }
 
+void Mesh::detach() {
+    if (!_external) {
+        return;
+    }
+    _vertexes.assign(_external->vertexes.begin(), _external->vertexes.end());
+    _textureUVs.assign(_external->textureUVs.begin(), _external->textureUVs.end());
+    _normals.assign(_external->normals.begin(), _external->normals.end());
+    _faces.assign(_external->faces.begin(), _external->faces.end());
+    _external.reset();
+}
+
+void Mesh::reserve(size_t vertices, size_t textureUVs, size_t normals, size_t faces) {
+    detach();
+    _vertexes.reserve(vertices);
+    _textureUVs.reserve(textureUVs);
+    _normals.reserve(normals);
+    _faces.reserve(faces);
+}
+
+void Mesh::append(std::span<vec3_t const> vertexes, std::span<vec2_t const> textureUVs, std::span<vec3_t const> normals, std::span<Face const> faces) {
+    detach();
+    _vertexes.insert(_vertexes.end(), vertexes.begin(), vertexes.end());
+    _textureUVs.insert(_textureUVs.end(), textureUVs.begin(), textureUVs.end());
+    _normals.insert(_normals.end(), normals.begin(), normals.end());
+    _faces.insert(_faces.end(), faces.begin(), faces.end());
+}
+
+WeldStats Mesh::weld(double tolerance) {
+    detach();
+
+    WeldStats stats;
+    stats.vertexesBefore = _vertexes.size();
+    stats.textureUVsBefore = _textureUVs.size();
+    stats.normalsBefore = _normals.size();
+
+    Welder<scalar_t, 3> vertexes(std::span<vec3_t const>{_vertexes}, tolerance);
+    Welder<scalar_t, 2> textureUVs(std::span<vec2_t const>{_textureUVs}, tolerance);
+    Welder<scalar_t, 3> normals(std::span<vec3_t const>{_normals}, tolerance);
+
+    for (Face & face : _faces) {
+        for (VertexIndex & index : face.indexes) {
+            index.vertex = vertexes(index.vertex);
+            index.texture = textureUVs(index.texture);
+            index.normal = normals(index.normal);
+        }
+    }
+
+    _vertexes = vertexes.release();
+    _textureUVs = textureUVs.release();
+    _normals = normals.release();
+
+    stats.vertexesAfter = _vertexes.size();
+    stats.textureUVsAfter = _textureUVs.size();
+    stats.normalsAfter = _normals.size();
+    return stats;
+}
+
 void Mesh::addVertex(vec3_t const & vertex) {
+    detach();
     _vertexes.emplace_back(vertex);
 }
 
 void Mesh::addTextureUV(vec2_t const & textureUV) {
+    detach();
     _textureUVs.emplace_back(textureUV);
 }
 
 void Mesh::addNormal(vec3_t const & normal) {
+    detach();
     _normals.emplace_back(normal);
 }
 
 void Mesh::addFace(Face const & face) {
+    detach();
     _faces.emplace_back(face);
 }
 
 void Mesh::addSimpleTriangle(vec3_t v1, vec3_t v2, vec3_t v3) {
+    detach();
     int numFaces = static_cast<int>(_vertexes.size());
 
     addVertex(v1);
@@ -0,0 +1,206 @@
+#include "meshcache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#include "mappedfile.h"
+
+namespace
+{
+
+using simplegl::Face;
+using simplegl::MeshCache;
+
+constexpr char kMagic[8] = {'S', 'G', 'L', 'M', 'E', 'S', 'H', '\0'};
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+static_assert(std::is_trivially_copyable_v<simplegl::vec3_t> && std::is_trivially_copyable_v<simplegl::vec2_t> && std::is_trivially_copyable_v<Face>);
+static_assert(sizeof(simplegl::vec3_t) == 3*sizeof(simplegl::scalar_t) && sizeof(Face) == 9*sizeof(int));
+
+size_t alignUp(size_t offset) {
+    return (offset + MeshCache::kMeshCacheAlignment - 1)/MeshCache::kMeshCacheAlignment*MeshCache::kMeshCacheAlignment;
+}
+
+// Byte offsets of the four arrays and the total file size.
+struct Layout {
+    size_t vertexes;
+    size_t textureUVs;
+    size_t normals;
+    size_t faces;
+    size_t size;
+};
+
+Layout layoutFor(MeshCache::Header const & header) {
+    Layout layout;
+    layout.vertexes = alignUp(sizeof(MeshCache::Header));
+    layout.textureUVs = alignUp(layout.vertexes + header.vertexCount*sizeof(simplegl::vec3_t));
+    layout.normals = alignUp(layout.textureUVs + header.textureUVCount*sizeof(simplegl::vec2_t));
+    layout.faces = alignUp(layout.normals + header.normalCount*sizeof(simplegl::vec3_t));
+    layout.size = layout.faces + header.faceCount*sizeof(Face);
+    return layout;
+}
+
+// Zero fills up to offset, the arrays are written in file order.
+bool padTo(std::ofstream & ofs, size_t offset) {
+    static constexpr char zeros[MeshCache::kMeshCacheAlignment] = {};
+    const auto position = static_cast<size_t>(ofs.tellp());
+    if (position < offset) {
+        ofs.write(zeros, static_cast<std::streamsize>(offset - position));
+    }
+    return static_cast<bool>(ofs);
+}
+
+template <typename T>
+bool writeArray(std::ofstream & ofs, size_t offset, std::span<T const> values) {
+    padTo(ofs, offset);
+    ofs.write(reinterpret_cast<char const *>(values.data()), static_cast<std::streamsize>(values.size_bytes()));
+    return static_cast<bool>(ofs);
+}
+
+template <typename T>
+std::span<T const> viewArray(char const * base, size_t offset, uint64_t count) {
+    return std::span<T const>{reinterpret_cast<T const *>(base + offset), static_cast<size_t>(count)};
+}
+
+// Whether every face index points into the cached arrays, the texture UV and
+// normal ones may also be kNoIndex. Reads every face once.
+bool indexesInRange(std::span<Face const> faces, MeshCache::Header const & header) {
+    auto inRange = [](int index, uint64_t count, bool optional) {
+        return (optional && index == simplegl::kNoIndex) || (index >= 0 && static_cast<uint64_t>(index) < count);
+    };
+    for (Face const & face : faces) {
+        for (simplegl::VertexIndex const & corner : face.indexes) {
+            if (!inRange(corner.vertex, header.vertexCount, false) ||
+                !inRange(corner.texture, header.textureUVCount, true) ||
+                !inRange(corner.normal, header.normalCount, true)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+namespace simplegl
+{
+
+std::string MeshCache::pathFor(std::string_view objPath) {
+    return std::string{objPath} + ".meshcache";
+}
+
+bool MeshCache::save(Mesh const & mesh, std::string_view path) {
+
+    Header header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrderMark = kByteOrderMark;
+    header.scalarSize = sizeof(scalar_t);
+    header.vertexCount = mesh.vertices().size();
+    header.textureUVCount = mesh.textureUVs().size();
+    header.normalCount = mesh.normals().size();
+    header.faceCount = mesh.faces().size();
+
+    for (int i = 0; i < 3; ++i) {
+        header.boundsMin[i] = mesh.vertices().empty() ? 0.0 : mesh.vertices()[0][i];
+        header.boundsMax[i] = header.boundsMin[i];
+    }
+    for (vec3_t const & vertex : mesh.vertices()) {
+        for (int i = 0; i < 3; ++i) {
+            header.boundsMin[i] = std::min<double>(header.boundsMin[i], vertex[i]);
+            header.boundsMax[i] = std::max<double>(header.boundsMax[i], vertex[i]);
+        }
+    }
+
+    const Layout layout = layoutFor(header);
+
+    // Written under a temporary name and renamed, so a reader never maps a
+    // partially written cache
+    const std::string finalPath{path};
+    const std::string tempPath = finalPath + ".tmp";
+    {
+        std::ofstream ofs{tempPath, std::ios::binary | std::ios::trunc};
+        ofs.write(reinterpret_cast<char const *>(&header), sizeof(header));
+
+        const bool written = ofs &&
+            writeArray(ofs, layout.vertexes, mesh.vertices()) &&
+            writeArray(ofs, layout.textureUVs, mesh.textureUVs()) &&
+            writeArray(ofs, layout.normals, mesh.normals()) &&
+            writeArray(ofs, layout.faces, mesh.faces()) &&
+            padTo(ofs, layout.size);
+        ofs.close();
+
+        if (!written || !ofs) {
+            std::cerr << "Could not write mesh cache " << tempPath << '\n';
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+        std::cerr << "Could not write mesh cache " << finalPath << '\n';
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<Mesh> MeshCache::load(std::string_view path) {
+
+    auto file = MappedFile::open(path);
+    if (!file.has_value()) {
+        return std::nullopt;
+    }
+    const std::string_view contents = file->contents();
+
+    Header header;
+    if (contents.size() < sizeof(Header)) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, contents.data(), sizeof(Header));
+
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion ||
+        header.byteOrderMark != kByteOrderMark ||
+        header.scalarSize != sizeof(scalar_t)) {
+        return std::nullopt;
+    }
+
+    // Counts are checked against the file size before any view is built,
+    // bounded first so the layout arithmetic cannot overflow
+    if ((header.vertexCount | header.textureUVCount | header.normalCount | header.faceCount) >= (uint64_t{1} << 40) ||
+        layoutFor(header).size > contents.size()) {
+        std::cerr << "Mesh cache " << path << " is truncated\n";
+        return std::nullopt;
+    }
+
+    const Layout layout = layoutFor(header);
+    auto owner = std::make_shared<MappedFile const>(std::move(*file));
+    char const * base = owner->contents().data();
+
+    // Mappings are page aligned, only a file read into memory can be off
+    if (reinterpret_cast<uintptr_t>(base) % alignof(std::max_align_t) != 0) {
+        return std::nullopt;
+    }
+
+    // A corrupt cache is rebuilt rather than read out of bounds later
+    const auto faces = viewArray<Face>(base, layout.faces, header.faceCount);
+    if (!indexesInRange(faces, header)) {
+        std::cerr << "Mesh cache " << path << " has face indexes out of range\n";
+        return std::nullopt;
+    }
+
+    return Mesh::view(
+        owner,
+        viewArray<vec3_t>(base, layout.vertexes, header.vertexCount),
+        viewArray<vec2_t>(base, layout.textureUVs, header.textureUVCount),
+        viewArray<vec3_t>(base, layout.normals, header.normalCount),
+        faces);
+}
+
+}
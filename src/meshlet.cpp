@@ -0,0 +1,264 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+using simplegl::vec3d_t;
+
+// Normals wider than this from the axis (about 84 degrees) leave the cone
+// disabled: a cone that wide would nearly never cull anything.
+constexpr double kMinConeCosine = 0.1;
+
+struct FaceData {
+    std::array<int, 3> vertexes;
+    // Zero for degenerate faces, they do not widen the normal cone
+    vec3d_t normal;
+};
+
+class MeshletBuilder {
+
+public:
+
+    explicit MeshletBuilder(simplegl::Mesh const & mesh) :
+    _vertices{mesh.vertices()},
+    _local_index(mesh.vertices().size(), -1),
+    _position_index(mesh.vertices().size(), -1) {
+
+        for (auto const & face : mesh.faces()) {
+            FaceData data;
+            bool valid = true;
+            for (int i = 0; i < 3; ++i) {
+                data.vertexes[i] = face.indexes[i].vertex;
+                valid = valid && data.vertexes[i] >= 0 && static_cast<size_t>(data.vertexes[i]) < _vertices.size();
+            }
+            if (!valid) continue;
+
+            const vec3d_t a = simplegl::vecCast<double>(_vertices[data.vertexes[0]]);
+            const vec3d_t normal = cross(simplegl::vecCast<double>(_vertices[data.vertexes[1]]) - a, simplegl::vecCast<double>(_vertices[data.vertexes[2]]) - a);
+            const double normalLength = length(normal);
+            data.normal = normalLength > 0.0 ? normal/normalLength : vec3d_t{};
+            _faces.emplace_back(data);
+        }
+
+        // Faces around each vertex, as offsets into one flat array
+        _vertex_face_offsets.assign(_vertices.size() + 1, 0);
+        for (auto const & face : _faces) {
+            for (int vertex : face.vertexes) ++_vertex_face_offsets[vertex + 1];
+        }
+        for (size_t vertex = 0; vertex < _vertices.size(); ++vertex) {
+            _vertex_face_offsets[vertex + 1] += _vertex_face_offsets[vertex];
+        }
+        _vertex_faces.resize(_vertex_face_offsets.back());
+        std::vector<uint32_t> fill(_vertex_face_offsets.begin(), _vertex_face_offsets.end() - 1);
+        for (uint32_t face = 0; face < _faces.size(); ++face) {
+            for (int vertex : _faces[face].vertexes) _vertex_faces[fill[vertex]++] = face;
+        }
+
+        _assigned.assign(_faces.size(), 0);
+    }
+
+    simplegl::MeshletMesh build() {
+        size_t seed = 0;
+        for (;;) {
+            while (seed < _faces.size() && _assigned[seed]) ++seed;
+            if (seed == _faces.size()) break;
+            buildMeshlet(static_cast<uint32_t>(seed));
+        }
+        return std::move(_result);
+    }
+
+private:
+
+    int newVertexes(FaceData const & face) const {
+        int count = 0;
+        for (int vertex : face.vertexes) {
+            if (_local_index[vertex] < 0) ++count;
+        }
+        // A face can repeat a vertex
+        if (face.vertexes[0] == face.vertexes[1] || face.vertexes[1] == face.vertexes[2] || face.vertexes[0] == face.vertexes[2]) {
+            int unique = 0;
+            for (int i = 0; i < 3; ++i) {
+                const int vertex = face.vertexes[i];
+                bool repeated = false;
+                for (int j = 0; j < i; ++j) repeated = repeated || face.vertexes[j] == vertex;
+                if (!repeated && _local_index[vertex] < 0) ++unique;
+            }
+            return unique;
+        }
+        return count;
+    }
+
+    void addFace(uint32_t face, vec3d_t & normalSum) {
+        _assigned[face] = 1;
+        normalSum = normalSum + _faces[face].normal;
+        _meshlet_faces.emplace_back(face);
+
+        for (int vertex : _faces[face].vertexes) {
+            if (_local_index[vertex] >= 0) continue;
+            _local_index[vertex] = static_cast<int>(_meshlet_vertexes.size());
+            _meshlet_vertexes.emplace_back(vertex);
+            for (uint32_t i = _vertex_face_offsets[vertex]; i < _vertex_face_offsets[vertex + 1]; ++i) {
+                if (!_assigned[_vertex_faces[i]]) _candidates.emplace_back(_vertex_faces[i]);
+            }
+        }
+    }
+
+    void buildMeshlet(uint32_t seed) {
+        _meshlet_faces.clear();
+        _meshlet_vertexes.clear();
+        _candidates.clear();
+        vec3d_t normalSum{};
+
+        addFace(seed, normalSum);
+
+        while (_meshlet_faces.size() < simplegl::kMeshletMaxTriangles) {
+            const double sumLength = length(normalSum);
+            const vec3d_t axis = sumLength > 0.0 ? normalSum/sumLength : vec3d_t{};
+
+            int best = -1;
+            int bestNew = 4;
+            double bestAlignment = -std::numeric_limits<double>::infinity();
+
+            // Assigned faces are dropped from the candidates while scanning
+            size_t kept = 0;
+            for (size_t i = 0; i < _candidates.size(); ++i) {
+                const uint32_t face = _candidates[i];
+                if (_assigned[face]) continue;
+                _candidates[kept++] = face;
+
+                const int added = newVertexes(_faces[face]);
+                if (_meshlet_vertexes.size() + added > simplegl::kMeshletMaxVertexes) continue;
+
+                const double alignment = dot(_faces[face].normal, axis);
+                if (added < bestNew || (added == bestNew && alignment > bestAlignment)) {
+                    best = static_cast<int>(face);
+                    bestNew = added;
+                    bestAlignment = alignment;
+                }
+            }
+            _candidates.resize(kept);
+
+            if (best < 0) break;
+            addFace(static_cast<uint32_t>(best), normalSum);
+        }
+
+        finishMeshlet(normalSum);
+
+        for (int vertex : _meshlet_vertexes) _local_index[vertex] = -1;
+    }
+
+    void finishMeshlet(vec3d_t const & normalSum) {
+        simplegl::Meshlet meshlet;
+        meshlet.vertexCount = static_cast<uint32_t>(_meshlet_vertexes.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(_result.triangles.size()/3);
+        meshlet.triangleCount = static_cast<uint32_t>(_meshlet_faces.size());
+
+        meshlet.vertexOffset = static_cast<uint32_t>(_result.vertexes.size());
+        meshlet.firstOwnedVertex = static_cast<uint32_t>(_result.positions.size());
+
+        vec3d_t low{std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+        vec3d_t high = -low;
+        for (int vertex : _meshlet_vertexes) {
+            auto const & position = _vertices[vertex];
+            if (_position_index[vertex] < 0) {
+                _position_index[vertex] = static_cast<int>(_result.positions.size());
+                _result.positions.x.emplace_back(position.x);
+                _result.positions.y.emplace_back(position.y);
+                _result.positions.z.emplace_back(position.z);
+                _result.owners.emplace_back(static_cast<uint32_t>(_result.meshlets.size()));
+            }
+            _result.vertexes.emplace_back(static_cast<uint32_t>(_position_index[vertex]));
+
+            const vec3d_t p = simplegl::vecCast<double>(position);
+            for (int i = 0; i < 3; ++i) {
+                low[i] = std::min(low[i], p[i]);
+                high[i] = std::max(high[i], p[i]);
+            }
+        }
+        meshlet.ownedVertexCount = static_cast<uint32_t>(_result.positions.size()) - meshlet.firstOwnedVertex;
+
+        meshlet.center = (low + high)*0.5;
+        for (int vertex : _meshlet_vertexes) {
+            meshlet.radius = std::max(meshlet.radius, length(simplegl::vecCast<double>(_vertices[vertex]) - meshlet.center));
+        }
+
+        for (uint32_t face : _meshlet_faces) {
+            for (int vertex : _faces[face].vertexes) {
+                _result.triangles.emplace_back(static_cast<uint8_t>(_local_index[vertex]));
+            }
+        }
+
+        const double sumLength = length(normalSum);
+        if (sumLength > 0.0) {
+            meshlet.coneAxis = normalSum/sumLength;
+            double minCosine = 1.0;
+            for (uint32_t face : _meshlet_faces) {
+                vec3d_t const & normal = _faces[face].normal;
+                if (normal.x == 0.0 && normal.y == 0.0 && normal.z == 0.0) continue;
+                minCosine = std::min(minCosine, dot(normal, meshlet.coneAxis));
+            }
+            if (minCosine >= kMinConeCosine) {
+                meshlet.coneSine = std::sqrt(std::max(0.0, 1.0 - minCosine*minCosine));
+            }
+        }
+
+        _result.meshlets.emplace_back(meshlet);
+    }
+
+    std::span<simplegl::vec3_t const> _vertices;
+    std::vector<FaceData> _faces;
+    std::vector<uint32_t> _vertex_face_offsets;
+    std::vector<uint32_t> _vertex_faces;
+    std::vector<uint8_t> _assigned;
+
+    // Meshlet being built: its faces, its vertexes and their local indexes
+    // (-1 when not in it), and the unassigned faces touching it
+    std::vector<uint32_t> _meshlet_faces;
+    std::vector<int> _meshlet_vertexes;
+    std::vector<int> _local_index;
+    std::vector<uint32_t> _candidates;
+
+    // Index of each mesh vertex in the result positions, -1 until used
+    std::vector<int> _position_index;
+
+    simplegl::MeshletMesh _result;
+
+};
+
+}
+
+namespace simplegl
+{
+
+MeshletMesh buildMeshlets(Mesh const & mesh) {
+    return MeshletBuilder(mesh).build();
+}
+
+MeshletCuller::MeshletCuller(ClipVolume const & volume, mat4d_t const & modelToClip, vec3d_t const & eye) :
+_planes{frustumPlanes(volume, modelToClip)},
+_eye{eye} {
+}
+
+bool MeshletCuller::visible(Meshlet const & meshlet) const {
+    if (sphereOutside(_planes, meshlet.center, meshlet.radius)) {
+        return false;
+    }
+
+    // Back facing when every point p of the sphere sees the eye more than
+    // 90 degrees off every normal: dot(axis, p - eye) > sin*|p - eye| for
+    // all of them, which the center test below implies
+    if (meshlet.coneSine <= 1.0) {
+        const vec3d_t toCenter = meshlet.center - _eye;
+        if (dot(meshlet.coneAxis, toCenter) > meshlet.coneSine*length(toCenter) + meshlet.radius*(1.0 + meshlet.coneSine)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
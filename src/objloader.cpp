@@ -1,284 +1,408 @@
 #include "objloader.h"
 
+#include <algorithm>
+#include <atomic>
 #include <charconv>
-#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
-#include <string>
-#include <ranges>
+#include <thread>
+#include <vector>
+
+#include "mappedfile.h"
+#include "meshcache.h"
+#include "vertexcache.h"
 
 namespace
 {
 
-std::vector<std::string_view> splitStrView(std::string_view str, char delimiter, bool skipEmpty = true) {
-    std::vector<std::string_view> result;
-    result.reserve(4);
-
-    for (auto it : std::views::split(str, delimiter)) {
-
-        auto sv = std::string_view{it.begin(), it.end()};
-        if (skipEmpty && sv.empty()) {
-            continue;
-        }
-
-        result.emplace_back(sv);
-    }
+using simplegl::Face;
+using simplegl::VertexIndex;
+using simplegl::kNoIndex;
+using simplegl::scalar_t;
 
-    return result;
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 }
 
-std::optional<double> doubleFromStrView(std::string_view sv) {
-    std::string str{sv};
-    try {
-        return std::stod(str);
-    } catch (std::exception const & e) {
-        std::cerr << "Could not convert " << sv << "to double\n";
-        return std::nullopt;
+// Whitespace separated tokens of one line, comment already cut off. Works on
+// the file bytes in place, nothing is copied or allocated.
+struct LineTokens {
+    char const * it;
+    char const * end;
+
+    // Empty once the line is exhausted
+    std::string_view next() {
+        while (it != end && isSpace(*it)) ++it;
+        char const * start = it;
+        while (it != end && !isSpace(*it)) ++it;
+        return std::string_view{start, static_cast<size_t>(it - start)};
     }
-}
+};
+
+// Calls line(lineNr, tokens) for every line of contents, 1-based lineNr.
+// Returns false as soon as line() does.
+template <typename LineFunction>
+bool forEachLine(std::string_view contents, LineFunction && line) {
+    char const * it = contents.data();
+    char const * const end = it + contents.size();
+
+    for (int lineNr = 1; it != end; ++lineNr) {
+        char const * lineEnd = static_cast<char const *>(std::memchr(it, '\n', static_cast<size_t>(end - it)));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
 
-std::optional<int> intFromStrView(std::string_view sv) {
-    int value;
-    auto result = std::from_chars(sv.data(), sv.data() + sv.size(), value);
-    if (result.ec == std::errc::invalid_argument || result.ec == std::errc::result_out_of_range) {
-        std::cerr << "Could not convert " << sv << "to int\n";
-        return std::nullopt;
-    } else {
-        return value;
-    }
-}
+        char const * comment = static_cast<char const *>(std::memchr(it, '#', static_cast<size_t>(lineEnd - it)));
+        if (!line(lineNr, LineTokens{it, comment ? comment : lineEnd})) {
+            return false;
+        }
 
-bool hasElementWithSeparator(std::vector<std::string_view> const & elements) {
-    return std::any_of(elements.begin(), elements.end(), [](std::string_view sv) {
-        return std::any_of(sv.cbegin(), sv.cend(), [](char c){
-            return c == '/';
-        });
-    });
+        it = lineEnd == end ? end : lineEnd + 1;
+    }
+    return true;
 }
 
+bool parseScalar(std::string_view token, scalar_t & value) {
+    char const * first = token.data();
+    char const * last = first + token.size();
+    // from_chars does not take a leading plus sign
+    if (first != last && *first == '+') ++first;
+    auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc{} && result.ptr == last && first != last;
 }
 
-namespace simplegl
-{
-
-static std::optional<vec3_t> parseVec3FromSplitElements(std::vector<std::string_view> const & elements) {
-
-    auto xOpt = doubleFromStrView(elements[1]);
-    auto yOpt = doubleFromStrView(elements[2]);
-    auto zOpt = doubleFromStrView(elements[3]);
-
-    if (xOpt.has_value() &&
-        yOpt.has_value() &&
-        zOpt.has_value()) {
-
-        return vec3_t{
-            xOpt.value(),
-            yOpt.value(),
-            -zOpt.value()
-        };
-
-    } else {
-        std::cerr << "Could not parse split elements to vec3\n";
-        return std::nullopt;
+// Parses count scalars, further tokens (like a vertex w) are ignored.
+bool parseScalars(LineTokens & tokens, scalar_t* values, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!parseScalar(tokens.next(), values[i])) {
+            return false;
+        }
     }
+    return true;
 }
 
-static std::optional<VertexIndex> parseVertexIndexFromStrView(std::string_view sv) {
-
-    auto indexesStrView = splitStrView(sv, '/', false);
-    
-    VertexIndex vertexIndex;
-
-    if (indexesStrView.size() != 3) {
-        goto parseFailed;
+// OBJ indexes are 1-based, negative ones count back from the last element
+// defined so far, here so far within the chunk. Empty fields (v//n) give
+// kNoIndex. Indexes are only range checked once the whole file is merged.
+bool parseIndex(std::string_view field, size_t defined, int & index, bool & relative) {
+    relative = false;
+    if (field.empty()) {
+        index = kNoIndex;
+        return true;
     }
 
-    {
-        auto indexVertexOpt = indexesStrView[0].empty() ? kNoIndex : intFromStrView(indexesStrView[0]);
-        auto indexTextureOpt = indexesStrView[1].empty() ? kNoIndex : intFromStrView(indexesStrView[1]);
-        auto indexNormalOpt = indexesStrView[2].empty() ? kNoIndex : intFromStrView(indexesStrView[2]);
-
-        if (indexVertexOpt.has_value() &&
-            indexTextureOpt.has_value() &&
-            indexNormalOpt.has_value()) {
+    int value = 0;
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    if (result.ec != std::errc{} || result.ptr != field.data() + field.size() || value == 0) {
+        return false;
+    }
 
-                vertexIndex.vertex = indexVertexOpt.value() - 1;
-                vertexIndex.texture = indexTextureOpt.value() - 1;
-                vertexIndex.normal = indexNormalOpt.value() - 1;
+    if (value > 0) {
+        index = value - 1;
+        return true;
+    }
+    // May point before the chunk, see RelativeIndex
+    index = static_cast<int>(static_cast<int64_t>(defined) + value);
+    relative = true;
+    return true;
+}
 
-        } else {
-            goto parseFailed;
+struct ElementCounts {
+    size_t vertices = 0;
+    size_t textureUVs = 0;
+    size_t normals = 0;
+    size_t faces = 0;
+};
+
+// One of v, v/t, v//n, v/t/n.
+bool parseCorner(std::string_view token, ElementCounts const & defined, VertexIndex & corner, bool (&relative)[3]) {
+    const size_t slash = token.find('/');
+    const std::string_view vertex = token.substr(0, slash);
+    std::string_view texture;
+    std::string_view normal;
+
+    if (slash != std::string_view::npos) {
+        const std::string_view rest = token.substr(slash + 1);
+        const size_t secondSlash = rest.find('/');
+        texture = rest.substr(0, secondSlash);
+        if (secondSlash != std::string_view::npos) {
+            normal = rest.substr(secondSlash + 1);
         }
     }
 
-    return vertexIndex;
-
-    parseFailed:
-    std::cerr << "Parsing vertex index from " << sv << " failed";
-    return std::nullopt;
+    return !vertex.empty() &&
+        parseIndex(vertex, defined.vertices, corner.vertex, relative[0]) &&
+        parseIndex(texture, defined.textureUVs, corner.texture, relative[1]) &&
+        parseIndex(normal, defined.normals, corner.normal, relative[2]);
 }
 
-static std::optional<vec2_t> parseVec2FromSplitElements(std::vector<std::string_view> const & elements) {
-    auto xOpt = doubleFromStrView(elements[1]);
-    auto yOpt = doubleFromStrView(elements[2]);
-
-    if (xOpt.has_value() &&
-       yOpt.has_value()) {
-
-        return vec2_t{
-            xOpt.value(),
-            yOpt.value()
-        };
-
-    } else {
-        std::cerr << "Could not parse split elements to vec2\n";
-        return std::nullopt;
-    }
+// Counting pre-pass so the Mesh vectors are allocated exactly once.
+ElementCounts countElements(std::string_view contents) {
+    ElementCounts counts;
+    forEachLine(contents, [&](int, LineTokens tokens) {
+        const std::string_view op = tokens.next();
+        if (op == "v") {
+            ++counts.vertices;
+        } else if (op == "vt") {
+            ++counts.textureUVs;
+        } else if (op == "vn") {
+            ++counts.normals;
+        } else if (op == "f") {
+            // Polygons are triangulated as fans, corners - 2 triangles
+            int corners = 0;
+            while (!tokens.next().empty()) ++corners;
+            if (corners > 2) counts.faces += static_cast<size_t>(corners - 2);
+        }
+        return true;
+    });
+    return counts;
 }
 
-static std::optional<Face> parseSimpleFaceFromSplitElements(std::vector<std::string_view> const & elements) {
-
-    auto idxOpt1 = intFromStrView(elements[1]);
-    auto idxOpt2 = intFromStrView(elements[2]);
-    auto idxOpt3 = intFromStrView(elements[3]);
-
-    if (idxOpt1.has_value() &&
-        idxOpt2.has_value() &&
-        idxOpt3.has_value()) {
-
-        VertexIndex v1, v2, v3;
-        v1.vertex = idxOpt1.value() - 1;
-        v2.vertex = idxOpt2.value() - 1;
-        v3.vertex = idxOpt3.value() - 1;
-
-        return Face {
-            v1,
-            v2,
-            v3
-        };
-
-    } else {
-        std::cerr << "Could not parse split elements to simple Face\n";
-        return std::nullopt;
+bool indexesInRange(Face const & face, ElementCounts const & counts) {
+    for (VertexIndex const & corner : face.indexes) {
+        if (corner.vertex < 0 || static_cast<size_t>(corner.vertex) >= counts.vertices ||
+            corner.texture < kNoIndex || (corner.texture != kNoIndex && static_cast<size_t>(corner.texture) >= counts.textureUVs) ||
+            corner.normal < kNoIndex || (corner.normal != kNoIndex && static_cast<size_t>(corner.normal) >= counts.normals)) {
+            return false;
+        }
     }
+    return true;
 }
 
-static std::optional<Face> parseComplexFaceFromSplitElements(std::vector<std::string_view> const & elements, bool isQuad2ndTriangle = false) {
-
-    if (hasElementWithSeparator(elements)) {
-
-        int index1 = isQuad2ndTriangle ? 3 : 1;
-        int index2 = isQuad2ndTriangle ? 4 : 2;
-        int index3 = isQuad2ndTriangle ? 1 : 3;
-
-        auto indexOpt1 = parseVertexIndexFromStrView(elements[index1]);
-        auto indexOpt2 = parseVertexIndexFromStrView(elements[index2]);
-        auto indexOpt3 = parseVertexIndexFromStrView(elements[index3]);
+constexpr int VertexIndex::* kIndexFields[3] = {&VertexIndex::vertex, &VertexIndex::texture, &VertexIndex::normal};
+
+// An index written as a negative OBJ index. A chunk resolves it against the
+// elements it defined itself; once the chunks before it are known the merge
+// adds their element count.
+struct RelativeIndex {
+    uint32_t face;
+    uint8_t corner;
+    uint8_t field;
+};
+
+// Everything parsed from one line-aligned piece of the file.
+struct Chunk {
+    std::vector<simplegl::vec3_t> vertices;
+    std::vector<simplegl::vec2_t> textureUVs;
+    std::vector<simplegl::vec3_t> normals;
+    std::vector<Face> faces;
+    std::vector<RelativeIndex> relativeIndexes;
+
+    // Line within the chunk, 0 when it parsed
+    int failedLine = 0;
+    std::string_view failedText;
+};
+
+void parseChunk(std::string_view contents, Chunk & chunk) {
+
+    const ElementCounts expected = countElements(contents);
+    chunk.vertices.reserve(expected.vertices);
+    chunk.textureUVs.reserve(expected.textureUVs);
+    chunk.normals.reserve(expected.normals);
+    chunk.faces.reserve(expected.faces);
+
+    ElementCounts defined;
+    // Corners of the current face and which of their fields are relative,
+    // reused so faces do not allocate
+    std::vector<VertexIndex> corners;
+    std::vector<uint8_t> relativeFields;
+
+    forEachLine(contents, [&](int lineNr, LineTokens tokens) {
+        const LineTokens whole = tokens;
+        const std::string_view op = tokens.next();
+        bool ok = true;
+
+        if (op == "v" || op == "vn") {
+            scalar_t xyz[3];
+            ok = parseScalars(tokens, xyz, 3);
+            if (ok) {
+                // Right-handed OBJ to the left-handed view space
+                const simplegl::vec3_t value = {xyz[0], xyz[1], -xyz[2]};
+                if (op == "v") {
+                    chunk.vertices.emplace_back(value);
+                    ++defined.vertices;
+                } else {
+                    chunk.normals.emplace_back(value);
+                    ++defined.normals;
+                }
+            }
+        } else if (op == "vt") {
+            scalar_t uv[2];
+            ok = parseScalars(tokens, uv, 2);
+            if (ok) {
+                chunk.textureUVs.emplace_back(simplegl::vec2_t{uv[0], uv[1]});
+                ++defined.textureUVs;
+            }
+        } else if (op == "f") {
+            corners.clear();
+            relativeFields.clear();
+            bool anyRelative = false;
+            for (std::string_view token = tokens.next(); ok && !token.empty(); token = tokens.next()) {
+                VertexIndex corner;
+                bool relative[3] = {};
+                ok = parseCorner(token, defined, corner, relative);
+                corners.emplace_back(corner);
+                relativeFields.emplace_back(relative[0] | relative[1] << 1 | relative[2] << 2);
+                anyRelative = anyRelative || relativeFields.back() != 0;
+            }
+            ok = ok && corners.size() >= 3;
 
-        if (indexOpt1.has_value() &&
-            indexOpt2.has_value() &&
-            indexOpt3.has_value()) {
+            // Fan around the first corner, (0 1 2), (2 3 0), (3 4 0)...
+            // Corners are reversed because the z flip mirrors the winding.
+            for (size_t i = 0; ok && i + 2 < corners.size(); ++i) {
+                const size_t source[3] = {
+                    i == 0 ? size_t{2} : size_t{0},
+                    i == 0 ? 1 : i + 2,
+                    i == 0 ? 0 : i + 1
+                };
 
                 Face face;
-                face.indexes[2] = indexOpt1.value();
-                face.indexes[1] = indexOpt2.value();
-                face.indexes[0] = indexOpt3.value();
-                return face;
+                for (int slot = 0; slot < 3; ++slot) {
+                    face.indexes[slot] = corners[source[slot]];
+                    for (int field = 0; anyRelative && field < 3; ++field) {
+                        if (relativeFields[source[slot]] & (1 << field)) {
+                            chunk.relativeIndexes.emplace_back(RelativeIndex{
+                                static_cast<uint32_t>(chunk.faces.size()),
+                                static_cast<uint8_t>(slot),
+                                static_cast<uint8_t>(field)});
+                        }
+                    }
+                }
+                chunk.faces.emplace_back(face);
+            }
+        }
 
-        } else {
-            std::cerr << "Could not parse split elements to complex Face";
-            return std::nullopt;
+        if (!ok) {
+            chunk.failedLine = lineNr;
+            chunk.failedText = std::string_view{whole.it, static_cast<size_t>(whole.end - whole.it)};
         }
+        return ok;
+    });
+}
 
-    } else {
-        return parseSimpleFaceFromSplitElements(elements);
+// Splits contents into up to count pieces that each start at a line start.
+std::vector<std::string_view> splitAtLines(std::string_view contents, size_t count) {
+    std::vector<std::string_view> pieces;
+    size_t begin = 0;
+    for (size_t i = 1; i <= count && begin < contents.size(); ++i) {
+        size_t end = contents.size();
+        if (i < count) {
+            const size_t newline = contents.find('\n', std::max(begin, contents.size()/count*i));
+            end = newline == std::string_view::npos ? contents.size() : newline + 1;
+        }
+        pieces.emplace_back(contents.substr(begin, end - begin));
+        begin = end;
     }
+    return pieces;
 }
 
-std::optional<Mesh> ObjLoader::load(std::string_view path) {
-    auto result = Mesh{};
-    auto ifs = std::ifstream{path.data()};
-
-    std::string line;
-    int lineNr = 1;
-    while (std::getline(ifs, line)) {
-
-        auto commentIt = std::find_if(line.begin(), line.end(), [](char c) {
-            return c == '#';
-        });
+}
 
-        auto lineWithoutComment = std::string_view{line.begin(), commentIt};
+namespace simplegl
+{
 
-        auto splitElements = splitStrView(lineWithoutComment, ' ');
+std::optional<Mesh> ObjLoader::load(std::string_view path, unsigned threadCount) {
 
-        if (splitElements.empty()) {
-            ++lineNr;
-            continue;
+    auto file = MappedFile::open(path);
+    if (!file.has_value()) {
+        return std::nullopt;
+    }
+    const std::string_view contents = file->contents();
+
+    // A few chunks per thread so uneven ones (all faces, all vertexes)
+    // balance out. One thread parses the file as a single chunk.
+    threadCount = std::max(threadCount, 1u);
+    const std::vector<std::string_view> pieces = splitAtLines(contents, threadCount == 1 ? 1 : threadCount*4);
+    std::vector<Chunk> chunks(pieces.size());
+
+    std::atomic<size_t> nextChunk{0};
+    auto parseChunks = [&]() {
+        for (size_t i = nextChunk.fetch_add(1); i < chunks.size(); i = nextChunk.fetch_add(1)) {
+            parseChunk(pieces[i], chunks[i]);
         }
+    };
 
-        auto op = splitElements[0];
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < std::min<size_t>(threadCount, chunks.size()); ++i) {
+        workers.emplace_back(parseChunks);
+    }
+    parseChunks();
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    // Merge in file order. Chunk bases are the elements of all chunks before.
+    ElementCounts totals;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        Chunk & chunk = chunks[i];
 
-        if (op == "v" && splitElements.size() == 4) {
+        if (chunk.failedLine != 0) {
+            const size_t linesBefore = static_cast<size_t>(std::count(contents.data(), pieces[i].data(), '\n'));
+            std::cerr << "Parsing obj file " << path << " failed on line " << linesBefore + chunk.failedLine << ": " << chunk.failedText << '\n';
+            return std::nullopt;
+        }
 
-            auto optVertex = parseVec3FromSplitElements(splitElements);
-            if (optVertex.has_value()) {
-                result.addVertex(optVertex.value());
-            } else {
-                goto parseFailed;
+        const size_t bases[3] = {totals.vertices, totals.textureUVs, totals.normals};
+        for (RelativeIndex const & relative : chunk.relativeIndexes) {
+            int & index = chunk.faces[relative.face].indexes[relative.corner].*kIndexFields[relative.field];
+            index += static_cast<int>(bases[relative.field]);
+            if (index < 0) {
+                std::cerr << "Parsing obj file " << path << " failed: relative index before the first element\n";
+                return std::nullopt;
             }
+        }
 
-        } else
-        if (op == "vt" && splitElements.size() == 3) {
+        totals.vertices += chunk.vertices.size();
+        totals.textureUVs += chunk.textureUVs.size();
+        totals.normals += chunk.normals.size();
+        totals.faces += chunk.faces.size();
+    }
 
-            auto optTextureUV = parseVec2FromSplitElements(splitElements);
-            if (optTextureUV.has_value()) {
-                result.addTextureUV(optTextureUV.value());
-            } else {
-                goto parseFailed;
-            }
+    auto result = chunks.size() == 1 ?
+        Mesh{std::move(chunks[0].vertices), std::move(chunks[0].textureUVs), std::move(chunks[0].normals), std::move(chunks[0].faces)} :
+        Mesh{};
 
-        } else
-        if (op == "vn" && splitElements.size() == 4) {
+    if (chunks.size() > 1) {
+        result.reserve(totals.vertices, totals.textureUVs, totals.normals, totals.faces);
+        for (Chunk const & chunk : chunks) {
+            result.append(chunk.vertices, chunk.textureUVs, chunk.normals, chunk.faces);
+        }
+    }
 
-            auto optNormal = parseVec3FromSplitElements(splitElements);
-            if (optNormal.has_value()) {
-                result.addNormal(optNormal.value());
-            } else {
-                goto parseFailed;
-            }
+    for (Face const & face : result.faces()) {
+        if (!indexesInRange(face, totals)) {
+            std::cerr << "Parsing obj file " << path << " failed: face index out of range\n";
+            return std::nullopt;
+        }
+    }
 
-        } else
-        if (op == "f" && splitElements.size() == 4) {
-            auto optFace = parseComplexFaceFromSplitElements(splitElements);
-            if (optFace.has_value()) {
-                result.addFace(optFace.value());
-            } else {
-                goto parseFailed;
-            }
+    return result;
+}
 
-        }  else
-        if (op == "f" && splitElements.size() == 5) {
-            auto optFace1 = parseComplexFaceFromSplitElements(splitElements, false);
-            auto optFace2 = parseComplexFaceFromSplitElements(splitElements, true);
+std::optional<Mesh> ObjLoader::loadCached(std::string_view path, unsigned threadCount) {
 
-            if (optFace1.has_value() && optFace2.has_value()) {
-                result.addFace(optFace1.value());
-                result.addFace(optFace2.value());
-            } else {
-                goto parseFailed;
-            }
+    const std::string cachePath = MeshCache::pathFor(path);
+
+    std::error_code objError;
+    std::error_code cacheError;
+    const auto objTime = std::filesystem::last_write_time(path, objError);
+    const auto cacheTime = std::filesystem::last_write_time(cachePath, cacheError);
 
-        }  else
-         {
-            ++lineNr;
-            continue;
+    if (!objError && !cacheError && cacheTime > objTime) {
+        if (auto mesh = MeshCache::load(cachePath)) {
+            return mesh;
         }
     }
-    return result;
 
-    parseFailed:
-    std::cerr << "Parsing obj file " << path << " failed on line " <<  lineNr << ": " << line << '\n';
-    return std::nullopt;
+    auto mesh = load(path, threadCount);
+    if (mesh.has_value()) {
+        mesh = optimizeVertexCache(*mesh);
+        // A failed write (read-only directory, say) only costs the next start
+        MeshCache::save(*mesh, cachePath);
+    }
+    return mesh;
 }
 
 }
-
@@ -0,0 +1,133 @@
+#include "profiler.h"
+
+#ifdef SIMPLEGL_PROFILE
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+
+using simplegl::profile::ThreadBuffer;
+
+// Buffers outlive their threads so the trace still has the events of
+// threads that already exited
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry & registry() {
+    static Registry instance;
+    return instance;
+}
+
+void writeJsonString(std::ostream & out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+}
+
+namespace simplegl::profile
+{
+
+std::atomic<bool> gRecording{false};
+
+ThreadBuffer & registerThread() {
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->events.resize(kEventsPerThread);
+
+    Registry & instance = registry();
+    std::lock_guard lock(instance.mutex);
+    buffer->id = static_cast<uint32_t>(instance.buffers.size());
+    buffer->name = "thread " + std::to_string(buffer->id);
+    tThreadBuffer = buffer.get();
+    instance.buffers.emplace_back(std::move(buffer));
+    return *tThreadBuffer;
+}
+
+void setRecording(bool recording) {
+    gRecording.store(recording, std::memory_order_relaxed);
+}
+
+void setThreadName(std::string_view name) {
+    ThreadBuffer & buffer = tThreadBuffer ? *tThreadBuffer : registerThread();
+    std::lock_guard lock(registry().mutex);
+    buffer.name = name;
+}
+
+bool writeChromeTrace(std::string const & path) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write the trace " << path << '\n';
+        return false;
+    }
+
+    Registry & instance = registry();
+    std::lock_guard lock(instance.mutex);
+
+    // Timestamps in microseconds from the first event
+    int64_t origin = INT64_MAX;
+    for (auto const & buffer : instance.buffers) {
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t first = written > kEventsPerThread ? written - kEventsPerThread : 0;
+        for (uint64_t i = first; i < written; ++i) {
+            origin = std::min(origin, buffer->events[i & (kEventsPerThread - 1)].start);
+        }
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool firstEvent = true;
+    auto separator = [&]() {
+        out << (firstEvent ? "\n" : ",\n");
+        firstEvent = false;
+    };
+
+    for (auto const & buffer : instance.buffers) {
+        separator();
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+        writeJsonString(out, buffer->name);
+        out << "}}";
+
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t first = written > kEventsPerThread ? written - kEventsPerThread : 0;
+        for (uint64_t i = first; i < written; ++i) {
+            Event const & event = buffer->events[i & (kEventsPerThread - 1)];
+            separator();
+            out << "{\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << (event.start - origin)/1000.0;
+            if (event.type == EventType::Zone) {
+                out << ",\"ph\":\"X\",\"dur\":" << (event.value - event.start)/1000.0 << '}';
+            } else {
+                out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+            }
+        }
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        std::cerr << "Cannot write the trace " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+}
+
+#endif
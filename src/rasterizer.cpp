@@ -0,0 +1,336 @@
+#include "rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "spankernels.h"
+
+namespace
+{
+
+using simplegl::kSubPixelScale;
+
+constexpr int64_t kHalfPixel = kSubPixelScale/2;
+
+struct FixedPoint {
+    int64_t x = 0;
+    int64_t y = 0;
+};
+
+FixedPoint toFixed(simplegl::vec2_t const & vec) {
+    return FixedPoint{
+        std::llround(vec.x * kSubPixelScale),
+        std::llround(vec.y * kSubPixelScale)
+    };
+}
+
+int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) --q;
+    return q;
+}
+
+int64_t ceilDiv(int64_t a, int64_t b) {
+    return -floorDiv(-a, b);
+}
+
+// E(p) = a*p.x + b*p.y + c is positive on the left of v0 -> v1, i.e. inside a
+// counter-clockwise triangle. Edges that are not top or left edges get c
+// biased by one so pixel centers exactly on them fail the E >= 0 test.
+struct EdgeFunction {
+
+    EdgeFunction(FixedPoint v0, FixedPoint v1) :
+    a{v0.y - v1.y},
+    b{v1.x - v0.x},
+    c{v0.x*v1.y - v1.x*v0.y} {
+        const bool isTopLeft = (v1.y < v0.y) || (v1.y == v0.y && v1.x < v0.x);
+        if (!isTopLeft) c -= 1;
+    }
+
+    int64_t at(int64_t x, int64_t y) const {
+        return a*x + b*y + c;
+    }
+
+    int64_t a;
+    int64_t b;
+    int64_t c;
+};
+
+// Restricts [lo, hi] to the pixels x where e + step*(x - x0) >= 0, e being
+// the edge value at pixel x0. Returns false when nothing is left.
+bool narrowSpan(int64_t e, int64_t step, int64_t x0, int64_t & lo, int64_t & hi) {
+    if (step > 0) {
+        if (e < 0) lo = std::max(lo, x0 + ceilDiv(-e, step));
+    } else if (step < 0) {
+        if (e < 0) return false;
+        hi = std::min(hi, x0 + e / -step);
+    } else if (e < 0) {
+        return false;
+    }
+    return lo <= hi;
+}
+
+
+// Everything the span loop needs, built once per triangle.
+struct TriangleSetup {
+    int64_t minX = 0;
+    int64_t maxX = -1;
+    int64_t minY = 0;
+    int64_t maxY = -1;
+    int64_t rowValues[3] = {};
+    int64_t stepX[3] = {};
+    int64_t stepY[3] = {};
+
+    bool empty() const {
+        return minX > maxX || minY > maxY;
+    }
+};
+
+// Snaps abc to fixed point and clips its bounding box to clip and the
+// framebuffer. Returns false when a vertex exceeds kMaxRasterCoordinate.
+bool setupTriangle(simplegl::vec2_t const & a, simplegl::vec2_t const & b, simplegl::vec2_t const & c, simplegl::Rect const & clip, simplegl::Rect const & bounds, TriangleSetup & setup) {
+
+    for (simplegl::vec2_t const & vertex : {a, b, c}) {
+        // Written so that NaN coordinates are rejected as well
+        if (!(std::abs(vertex.x) <= simplegl::kMaxRasterCoordinate && std::abs(vertex.y) <= simplegl::kMaxRasterCoordinate)) {
+            return false;
+        }
+    }
+
+    FixedPoint v0 = toFixed(a);
+    FixedPoint v1 = toFixed(b);
+    FixedPoint v2 = toFixed(c);
+
+    const int64_t doubleArea = (v1.x - v0.x)*(v2.y - v0.y) - (v1.y - v0.y)*(v2.x - v0.x);
+    if (doubleArea == 0) {
+        return true;
+    }
+
+    // Both windings are filled, the edge functions expect counter-clockwise
+    if (doubleArea < 0) {
+        std::swap(v1, v2);
+    }
+
+    // Pixel (x, y) is sampled at its center, (x*16 + 8, y*16 + 8) in fixed point.
+    // The bounding box is clipped once, everything below works inside it.
+    setup.minX = std::max<int64_t>({ceilDiv(std::min({v0.x, v1.x, v2.x}) - kHalfPixel, kSubPixelScale), clip.x0, bounds.x0});
+    setup.maxX = std::min<int64_t>({floorDiv(std::max({v0.x, v1.x, v2.x}) - kHalfPixel, kSubPixelScale), clip.x1 - 1, bounds.x1 - 1});
+    setup.minY = std::max<int64_t>({ceilDiv(std::min({v0.y, v1.y, v2.y}) - kHalfPixel, kSubPixelScale), clip.y0, bounds.y0});
+    setup.maxY = std::min<int64_t>({floorDiv(std::max({v0.y, v1.y, v2.y}) - kHalfPixel, kSubPixelScale), clip.y1 - 1, bounds.y1 - 1});
+
+    if (setup.empty()) {
+        return true;
+    }
+
+    const EdgeFunction edges[3] = {
+        EdgeFunction(v1, v2),
+        EdgeFunction(v2, v0),
+        EdgeFunction(v0, v1)
+    };
+
+    const int64_t startX = setup.minX*kSubPixelScale + kHalfPixel;
+    const int64_t startY = setup.minY*kSubPixelScale + kHalfPixel;
+
+    for (int i = 0; i < 3; ++i) {
+        setup.rowValues[i] = edges[i].at(startX, startY);
+        setup.stepX[i] = edges[i].a*kSubPixelScale;
+        setup.stepY[i] = edges[i].b*kSubPixelScale;
+    }
+
+    return true;
+}
+
+// Calls span(y, lo, hi) for every row of the triangle with the covered,
+// inclusive pixel range [lo, hi].
+template <typename SpanFunction>
+void forEachSpan(TriangleSetup setup, SpanFunction && span) {
+    for (int64_t y = setup.minY; y <= setup.maxY; ++y) {
+        int64_t lo = setup.minX;
+        int64_t hi = setup.maxX;
+
+        if (narrowSpan(setup.rowValues[0], setup.stepX[0], setup.minX, lo, hi) &&
+            narrowSpan(setup.rowValues[1], setup.stepX[1], setup.minX, lo, hi) &&
+            narrowSpan(setup.rowValues[2], setup.stepX[2], setup.minX, lo, hi)) {
+
+            span(static_cast<int>(y), static_cast<int>(lo), static_cast<int>(hi));
+        }
+
+        setup.rowValues[0] += setup.stepY[0];
+        setup.rowValues[1] += setup.stepY[1];
+        setup.rowValues[2] += setup.stepY[2];
+    }
+}
+
+// Edge function fill without depth test, adds the pixels written to pixels.
+bool fillUntestedTriangle(simplegl::Framebuffer & framebuffer, simplegl::vec2_t const & a, simplegl::vec2_t const & b, simplegl::vec2_t const & c, uint32_t color, simplegl::Rect const & clip, uint64_t & pixels) {
+
+    TriangleSetup setup;
+    if (!setupTriangle(a, b, c, clip, framebuffer.bounds(), setup)) {
+        return false;
+    }
+
+    const simplegl::FillSpanKernel fillSpan = simplegl::spanKernels().fillSpan;
+
+    forEachSpan(setup, [&](int y, int lo, int hi) {
+        fillSpan(framebuffer.row(y) + lo, hi - lo + 1, color);
+        pixels += hi - lo + 1;
+    });
+
+    return true;
+}
+
+}
+
+namespace simplegl
+{
+
+RasterStats& RasterStats::operator+=(RasterStats const & other) {
+    triangles += other.triangles;
+    trianglesRejected += other.trianglesRejected;
+    blocksRejected += other.blocksRejected;
+    pixelsTested += other.pixelsTested;
+    pixelsWritten += other.pixelsWritten;
+    pixelsFilled += other.pixelsFilled;
+    return *this;
+}
+
+bool fillTriangle(Framebuffer & framebuffer, vec2_t const & a, vec2_t const & b, vec2_t const & c, uint32_t color, Rect const & clip) {
+    uint64_t pixels = 0;
+    return fillUntestedTriangle(framebuffer, a, b, c, color, clip, pixels);
+}
+
+bool fillTriangle(Framebuffer & framebuffer, vec2_t const & a, vec2_t const & b, vec2_t const & c, uint32_t color) {
+    return fillTriangle(framebuffer, a, b, c, color, framebuffer.bounds());
+}
+
+bool fillTriangle(Framebuffer & framebuffer, vec3_t const & a, vec3_t const & b, vec3_t const & c, uint32_t color, Rect const & clip, RasterStats & stats) {
+
+    TriangleSetup setup;
+    if (!setupTriangle({a.x, a.y}, {b.x, b.y}, {c.x, c.y}, clip, framebuffer.bounds(), setup)) {
+        return false;
+    }
+
+    if (setup.empty()) {
+        return true;
+    }
+
+    ++stats.triangles;
+
+    const int blockMinX = static_cast<int>(setup.minX)/kHiZBlockSize;
+    const int blockMaxX = static_cast<int>(setup.maxX)/kHiZBlockSize;
+    const int blockMinY = static_cast<int>(setup.minY)/kHiZBlockSize;
+    const int blockMaxY = static_cast<int>(setup.maxY)/kHiZBlockSize;
+
+    // Depth plane z(x, y) = a.z + dzdx*(x - a.x) + dzdy*(y - a.y), in double
+    // whatever the pipeline precision, float loses too much on thin triangles
+    const vec3d_t origin = vecCast<double>(a);
+    const vec3d_t normal = cross(vecCast<double>(b) - origin, vecCast<double>(c) - origin);
+    if (normal.z == 0.0) {
+        return true;
+    }
+    const double dzdx = -normal.x/normal.z;
+    const double dzdy = -normal.y/normal.z;
+    auto depthAt = [&](double x, double y) {
+        return origin.z + dzdx*(x - origin.x) + dzdy*(y - origin.y);
+    };
+
+    // The kernels step float depths along spans, which may round above the
+    // plane by a few float epsilons of the values summed. Rejects leave that
+    // much room, so hierarchical Z never drops a pixel the per pixel test
+    // would draw.
+    const double nearest = std::max({a.z, b.z, c.z});
+    const double farthest = std::min({a.z, b.z, c.z});
+    const double spanReach = std::abs(dzdx)*static_cast<double>(setup.maxX - setup.minX + 1);
+    const double slack = 2.0*std::numeric_limits<float>::epsilon()*(std::max(std::abs(nearest), std::abs(farthest)) + spanReach);
+
+    // Whole triangle (inside clip) behind everything already drawn there
+    bool occluded = true;
+    for (int by = blockMinY; by <= blockMaxY && occluded; ++by) {
+        for (int bx = blockMinX; bx <= blockMaxX && occluded; ++bx) {
+            occluded = nearest + slack <= framebuffer.hiZ(bx, by);
+        }
+    }
+
+    if (occluded) {
+        ++stats.trianglesRejected;
+        return true;
+    }
+
+    // Nearest depth the plane reaches over a block, for the per block test
+    const double blockReach = (std::abs(dzdx) + std::abs(dzdy))*kHiZBlockSize*0.5;
+
+    thread_local std::vector<uint8_t> visibleBlocks;
+    visibleBlocks.resize(blockMaxX - blockMinX + 1);
+    int currentBlockRow = -1;
+
+    const DepthSpanKernel depthSpan = spanKernels().depthSpan;
+
+    forEachSpan(setup, [&](int y, int lo, int hi) {
+
+        const int by = y/kHiZBlockSize;
+
+        if (by != currentBlockRow) {
+            currentBlockRow = by;
+            const double centerY = (by + 0.5)*kHiZBlockSize;
+            for (int bx = blockMinX; bx <= blockMaxX; ++bx) {
+                const double centerX = (bx + 0.5)*kHiZBlockSize;
+                const double blockNearest = std::min(nearest, depthAt(centerX, centerY) + blockReach);
+                const bool visible = blockNearest + slack > framebuffer.hiZ(bx, by);
+                visibleBlocks[bx - blockMinX] = visible;
+                if (!visible) ++stats.blocksRejected;
+            }
+        }
+
+        uint32_t* colorRow = framebuffer.row(y);
+        float* depthRow = framebuffer.depthRow(y);
+
+        // Runs of visible blocks go to the kernel in one call
+        int x = lo;
+        while (x <= hi) {
+            int bx = x/kHiZBlockSize;
+            if (!visibleBlocks[bx - blockMinX]) {
+                x = (bx + 1)*kHiZBlockSize;
+                continue;
+            }
+
+            const int runStart = x;
+            while (bx <= blockMaxX && visibleBlocks[bx - blockMinX] && bx*kHiZBlockSize <= hi) {
+                ++bx;
+            }
+            const int runEnd = std::min(hi, bx*kHiZBlockSize - 1);
+
+            const int count = runEnd - runStart + 1;
+            const float z0 = static_cast<float>(depthAt(runStart + 0.5, y + 0.5));
+            const int written = depthSpan(colorRow + runStart, depthRow + runStart, count, z0, static_cast<float>(dzdx), color);
+
+            stats.pixelsTested += count;
+            stats.pixelsWritten += written;
+
+            if (written > 0) {
+                for (int block = runStart/kHiZBlockSize; block <= runEnd/kHiZBlockSize; ++block) {
+                    framebuffer.invalidateHiZ(block, by);
+                }
+            }
+
+            x = runEnd + 1;
+        }
+    });
+
+    return true;
+}
+
+void fillTriangle(Framebuffer & framebuffer, vec3_t const & a, vec3_t const & b, vec3_t const & c, uint32_t color, Rect const & clip, FillMode fillMode, bool depthTest, RasterStats & stats) {
+    if (fillMode == FillMode::EdgeFunction) {
+        if (depthTest ?
+            fillTriangle(framebuffer, a, b, c, color, clip, stats) :
+            fillUntestedTriangle(framebuffer, {a.x, a.y}, {b.x, b.y}, {c.x, c.y}, color, clip, stats.pixelsFilled)) {
+            return;
+        }
+    }
+
+    stats.pixelsFilled += framebuffer.fillTriangle(a.x, a.y, b.x, b.y, c.x, c.y, color, clip);
+}
+
+}
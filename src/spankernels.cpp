@@ -0,0 +1,229 @@
+#include "spankernels.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMPLEGL_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// This file is built with -ffp-contract=off: a fused multiply-add in one
+// kernel would make its depth values differ from the scalar reference. Lane
+// indexes are kept as floats, they stay exact far beyond any span length.
+
+namespace
+{
+
+using simplegl::SimdLevel;
+using simplegl::SpanKernels;
+
+void fillSpanScalar(uint32_t* dst, int count, uint32_t color) {
+    std::fill(dst, dst + count, color);
+}
+
+int depthSpanScalar(uint32_t* color, float* depth, int count, float z0, float dz, uint32_t fill) {
+    int written = 0;
+    for (int i = 0; i < count; ++i) {
+        const float z = z0 + static_cast<float>(i)*dz;
+        if (z > depth[i]) {
+            depth[i] = z;
+            color[i] = fill;
+            ++written;
+        }
+    }
+    return written;
+}
+
+#ifdef SIMPLEGL_X86_KERNELS
+
+// SSE2 is part of x86-64, no masked stores: partial chunks go through the
+// scalar code. Full chunks blend, every lane belongs to the span.
+
+void fillSpanSSE2(uint32_t* dst, int count, uint32_t color) {
+    const __m128i value = _mm_set1_epi32(static_cast<int>(color));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+    }
+    fillSpanScalar(dst + i, count - i, color);
+}
+
+int depthSpanSSE2(uint32_t* color, float* depth, int count, float z0, float dz, uint32_t fill) {
+    const __m128 base = _mm_set1_ps(z0);
+    const __m128 step = _mm_set1_ps(dz);
+    const __m128i fillValue = _mm_set1_epi32(static_cast<int>(fill));
+    __m128 index = _mm_setr_ps(0, 1, 2, 3);
+    int written = 0;
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 z = _mm_add_ps(base, _mm_mul_ps(index, step));
+        const __m128 stored = _mm_loadu_ps(depth + i);
+        const __m128 pass = _mm_cmpgt_ps(z, stored);
+        const __m128i passMask = _mm_castps_si128(pass);
+        const __m128i oldColor = _mm_loadu_si128(reinterpret_cast<__m128i*>(color + i));
+
+        _mm_storeu_ps(depth + i, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(color + i), _mm_or_si128(_mm_and_si128(passMask, fillValue), _mm_andnot_si128(passMask, oldColor)));
+
+        written += __builtin_popcount(_mm_movemask_ps(pass));
+        index = _mm_add_ps(index, _mm_set1_ps(4));
+    }
+
+    // The tail keeps indexing from i so it computes the same z as one full run
+    for (; i < count; ++i) {
+        const float z = z0 + static_cast<float>(i)*dz;
+        if (z > depth[i]) {
+            depth[i] = z;
+            color[i] = fill;
+            ++written;
+        }
+    }
+    return written;
+}
+
+__attribute__((target("avx2")))
+__m256i tailMask8(int remaining) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lanes);
+}
+
+__attribute__((target("avx2")))
+void fillSpanAVX2(uint32_t* dst, int count, uint32_t color) {
+    const __m256i value = _mm256_set1_epi32(static_cast<int>(color));
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+    }
+    if (i < count) {
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), tailMask8(count - i), value);
+    }
+}
+
+__attribute__((target("avx2")))
+int depthSpanAVX2(uint32_t* color, float* depth, int count, float z0, float dz, uint32_t fill) {
+    const __m256 base = _mm256_set1_ps(z0);
+    const __m256 step = _mm256_set1_ps(dz);
+    const __m256i fillValue = _mm256_set1_epi32(static_cast<int>(fill));
+    __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    int written = 0;
+
+    for (int i = 0; i < count; i += 8) {
+        const __m256i lanes = tailMask8(count - i);
+        const __m256 z = _mm256_add_ps(base, _mm256_mul_ps(index, step));
+        const __m256 stored = _mm256_maskload_ps(depth + i, lanes);
+        const __m256i pass = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, stored, _CMP_GT_OQ)), lanes);
+
+        _mm256_maskstore_ps(depth + i, pass, z);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(color + i), pass, fillValue);
+
+        written += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(pass)));
+        index = _mm256_add_ps(index, _mm256_set1_ps(8));
+    }
+    return written;
+}
+
+__attribute__((target("avx512f")))
+void fillSpanAVX512(uint32_t* dst, int count, uint32_t color) {
+    const __m512i value = _mm512_set1_epi32(static_cast<int>(color));
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_si512(dst + i, value);
+    }
+    if (i < count) {
+        _mm512_mask_storeu_epi32(dst + i, static_cast<__mmask16>((1u << (count - i)) - 1), value);
+    }
+}
+
+__attribute__((target("avx512f")))
+int depthSpanAVX512(uint32_t* color, float* depth, int count, float z0, float dz, uint32_t fill) {
+    const __m512 base = _mm512_set1_ps(z0);
+    const __m512 step = _mm512_set1_ps(dz);
+    const __m512i fillValue = _mm512_set1_epi32(static_cast<int>(fill));
+    __m512 index = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    int written = 0;
+
+    for (int i = 0; i < count; i += 16) {
+        const int remaining = count - i;
+        const __mmask16 lanes = remaining >= 16 ? 0xFFFF : static_cast<__mmask16>((1u << remaining) - 1);
+        const __m512 z = _mm512_add_ps(base, _mm512_mul_ps(index, step));
+        const __m512 stored = _mm512_maskz_loadu_ps(lanes, depth + i);
+        const __mmask16 pass = _mm512_mask_cmp_ps_mask(lanes, z, stored, _CMP_GT_OQ);
+
+        _mm512_mask_storeu_ps(depth + i, pass, z);
+        _mm512_mask_storeu_epi32(color + i, pass, fillValue);
+
+        written += __builtin_popcount(pass);
+        index = _mm512_add_ps(index, _mm512_set1_ps(16));
+    }
+    return written;
+}
+
+#endif
+
+constexpr SpanKernels kScalarKernels = {SimdLevel::Scalar, fillSpanScalar, depthSpanScalar};
+#ifdef SIMPLEGL_X86_KERNELS
+constexpr SpanKernels kSSE2Kernels = {SimdLevel::SSE2, fillSpanSSE2, depthSpanSSE2};
+constexpr SpanKernels kAVX2Kernels = {SimdLevel::AVX2, fillSpanAVX2, depthSpanAVX2};
+constexpr SpanKernels kAVX512Kernels = {SimdLevel::AVX512, fillSpanAVX512, depthSpanAVX512};
+#endif
+
+SpanKernels const * kernelsFor(SimdLevel level) {
+    switch (level) {
+#ifdef SIMPLEGL_X86_KERNELS
+    case SimdLevel::SSE2: return &kSSE2Kernels;
+    case SimdLevel::AVX2: return &kAVX2Kernels;
+    case SimdLevel::AVX512: return &kAVX512Kernels;
+#endif
+    default: return &kScalarKernels;
+    }
+}
+
+SpanKernels const * activeKernels = kernelsFor(simplegl::detectSimdLevel());
+
+}
+
+namespace simplegl
+{
+
+SimdLevel detectSimdLevel() {
+#ifdef SIMPLEGL_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    return SimdLevel::SSE2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SpanKernels const & spanKernels() {
+    return *activeKernels;
+}
+
+bool selectSpanKernels(SimdLevel level) {
+    if (level > detectSimdLevel()) {
+        return false;
+    }
+    activeKernels = kernelsFor(level);
+    return true;
+}
+
+std::string_view toString(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE2: return "sse2";
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+std::optional<SimdLevel> simdLevelFromString(std::string_view name) {
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (toString(level) == name) return level;
+    }
+    return std::nullopt;
+}
+
+}
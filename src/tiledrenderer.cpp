@@ -0,0 +1,244 @@
+#include "tiledrenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "profiler.h"
+
+namespace simplegl
+{
+
+TiledRenderer::TiledRenderer(int width, int height, unsigned threadCount) :
+_tiles_x{(width + kTileSize - 1)/kTileSize},
+_tiles_y{(height + kTileSize - 1)/kTileSize},
+_width{width},
+_height{height},
+_bins(static_cast<size_t>(_tiles_x)*_tiles_y),
+_line_bins(_bins.size()),
+_stats(std::max(threadCount, 1u)) {
+
+    for (unsigned i = 1; i < std::max(threadCount, 1u); ++i) {
+        _workers.emplace_back([this, i](){ workerLoop(i); });
+    }
+}
+
+TiledRenderer::~TiledRenderer() {
+    {
+        std::lock_guard lock{_mutex};
+        _stop = true;
+    }
+    _frame_started.notify_all();
+
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+void TiledRenderer::render(Framebuffer & framebuffer, RenderJob const & job) {
+    SIMPLEGL_ZONE("tiled render");
+
+    bin(*job.vertexes);
+    if (job.lines) {
+        binLines(*job.lines);
+    }
+
+    _framebuffer = &framebuffer;
+    _job = job;
+    std::fill(_stats.begin(), _stats.end(), ThreadStats{});
+
+    {
+        std::lock_guard lock{_mutex};
+        _next_tile = 0;
+        _busy_workers = static_cast<unsigned>(_workers.size());
+        ++_frame;
+    }
+    _frame_started.notify_all();
+
+    renderTiles(0);
+
+    std::unique_lock lock{_mutex};
+    _frame_finished.wait(lock, [this](){ return _busy_workers == 0; });
+}
+
+RasterStats TiledRenderer::stats() const {
+    RasterStats total;
+    for (auto const & threadStats : _stats) {
+        total += threadStats.stats;
+    }
+    return total;
+}
+
+void TiledRenderer::bin(std::vector<vec3_t> const & vertexes) {
+    SIMPLEGL_ZONE("bin");
+
+    for (auto& bin : _bins) {
+        bin.clear();
+    }
+
+    for (size_t i = 0; i + 2 < vertexes.size(); i += 3) {
+        vec3_t const & a = vertexes[i];
+        vec3_t const & b = vertexes[i + 1];
+        vec3_t const & c = vertexes[i + 2];
+
+        if (!std::isfinite(a.x + a.y + b.x + b.y + c.x + c.y)) {
+            continue;
+        }
+
+        // Conservative pixel bounds of both the fill and the truncated
+        // wireframe endpoints, clamped before converting to int.
+        const double minX = std::clamp(std::floor(std::min({a.x, b.x, c.x})) - 1.0, 0.0, _width - 1.0);
+        const double maxX = std::clamp(std::ceil(std::max({a.x, b.x, c.x})) + 1.0, 0.0, _width - 1.0);
+        const double minY = std::clamp(std::floor(std::min({a.y, b.y, c.y})) - 1.0, 0.0, _height - 1.0);
+        const double maxY = std::clamp(std::ceil(std::max({a.y, b.y, c.y})) + 1.0, 0.0, _height - 1.0);
+
+        const int tileMinX = static_cast<int>(minX)/kTileSize;
+        const int tileMaxX = static_cast<int>(maxX)/kTileSize;
+        const int tileMinY = static_cast<int>(minY)/kTileSize;
+        const int tileMaxY = static_cast<int>(maxY)/kTileSize;
+
+        for (int ty = tileMinY; ty <= tileMaxY; ++ty) {
+            for (int tx = tileMinX; tx <= tileMaxX; ++tx) {
+                _bins[ty*_tiles_x + tx].emplace_back(static_cast<uint32_t>(i/3));
+            }
+        }
+    }
+}
+
+void TiledRenderer::binLines(std::vector<vec3_t> const & lines) {
+    SIMPLEGL_ZONE("bin lines");
+
+    for (auto& bin : _line_bins) {
+        bin.clear();
+    }
+
+    for (size_t i = 0; i + 1 < lines.size(); i += 2) {
+        vec3_t const & a = lines[i];
+        vec3_t const & b = lines[i + 1];
+
+        if (!std::isfinite(a.x + a.y + b.x + b.y)) {
+            continue;
+        }
+
+        // Same conservative bounds as the triangles, a line may also fall in
+        // tiles its bounds overlap without crossing them
+        const double minX = std::clamp(std::floor(std::min(a.x, b.x)) - 1.0, 0.0, _width - 1.0);
+        const double maxX = std::clamp(std::ceil(std::max(a.x, b.x)) + 1.0, 0.0, _width - 1.0);
+        const double minY = std::clamp(std::floor(std::min(a.y, b.y)) - 1.0, 0.0, _height - 1.0);
+        const double maxY = std::clamp(std::ceil(std::max(a.y, b.y)) + 1.0, 0.0, _height - 1.0);
+
+        for (int ty = static_cast<int>(minY)/kTileSize; ty <= static_cast<int>(maxY)/kTileSize; ++ty) {
+            for (int tx = static_cast<int>(minX)/kTileSize; tx <= static_cast<int>(maxX)/kTileSize; ++tx) {
+                _line_bins[ty*_tiles_x + tx].emplace_back(static_cast<uint32_t>(i/2));
+            }
+        }
+    }
+}
+
+void TiledRenderer::renderTiles(unsigned thread) {
+    SIMPLEGL_ZONE("tiles");
+    const int tileCount = static_cast<int>(_bins.size());
+    for (int tile = _next_tile.fetch_add(1); tile < tileCount; tile = _next_tile.fetch_add(1)) {
+        renderTile(tile, _stats[thread].stats);
+    }
+}
+
+void TiledRenderer::renderTile(int tileIndex, RasterStats & stats) {
+
+    const int tileX = (tileIndex % _tiles_x)*kTileSize;
+    const int tileY = (tileIndex / _tiles_x)*kTileSize;
+    const Rect clip = {
+        tileX,
+        tileY,
+        std::min(tileX + kTileSize, _width),
+        std::min(tileY + kTileSize, _height)
+    };
+
+    if (_job.restoreBackground) {
+        _framebuffer->restoreBackground(clip);
+    }
+
+    auto const & bin = _bins[tileIndex];
+    auto const & vertexes = *_job.vertexes;
+
+    for (uint32_t triangle : bin) {
+        fillTriangle(
+            *_framebuffer,
+            vertexes[3*triangle],
+            vertexes[3*triangle + 1],
+            vertexes[3*triangle + 2],
+            _job.fillColor,
+            clip,
+            _job.fillMode,
+            _job.depthTest,
+            stats);
+    }
+
+    const bool depthTestedWireframe = _job.depthTest && _job.fillMode == FillMode::EdgeFunction;
+
+    if (_job.lines) {
+        auto const & lines = *_job.lines;
+        for (uint32_t line : _line_bins[tileIndex]) {
+            vec3_t const & a = lines[2*line];
+            vec3_t const & b = lines[2*line + 1];
+            if (depthTestedWireframe) {
+                _framebuffer->drawLine(a, b, _job.wireColor, clip);
+            } else {
+                _framebuffer->drawLine(vec2_t{a.x, a.y}, vec2_t{b.x, b.y}, _job.wireColor, clip);
+            }
+        }
+        return;
+    }
+
+    for (uint32_t triangle : bin) {
+        const uint8_t edges = _job.edgeMasks ? (*_job.edgeMasks)[triangle] : kAllTriangleEdges;
+
+        if (depthTestedWireframe) {
+            _framebuffer->drawTriangle(
+                vertexes[3*triangle],
+                vertexes[3*triangle + 1],
+                vertexes[3*triangle + 2],
+                _job.wireColor,
+                clip,
+                edges);
+            continue;
+        }
+
+        _framebuffer->drawTriangle(
+            vec2_t{vertexes[3*triangle].x, vertexes[3*triangle].y},
+            vec2_t{vertexes[3*triangle + 1].x, vertexes[3*triangle + 1].y},
+            vec2_t{vertexes[3*triangle + 2].x, vertexes[3*triangle + 2].y},
+            _job.wireColor,
+            clip,
+            edges);
+    }
+}
+
+void TiledRenderer::workerLoop(unsigned thread) {
+#ifdef SIMPLEGL_PROFILE
+    profile::setThreadName("raster " + std::to_string(thread));
+#endif
+    uint64_t lastFrame = 0;
+
+    for (;;) {
+        {
+            std::unique_lock lock{_mutex};
+            _frame_started.wait(lock, [this, lastFrame](){ return _stop || _frame != lastFrame; });
+            if (_stop) {
+                return;
+            }
+            lastFrame = _frame;
+        }
+
+        renderTiles(thread);
+
+        {
+            std::lock_guard lock{_mutex};
+            if (--_busy_workers == 0) {
+                _frame_finished.notify_one();
+            }
+        }
+    }
+}
+
+}
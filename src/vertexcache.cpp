@@ -0,0 +1,250 @@
+#include "vertexcache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using simplegl::Face;
+
+bool inRange(int index, size_t count) {
+    return index >= 0 && static_cast<size_t>(index) < count;
+}
+
+// Triangles using each vertex, as offsets into one flat array.
+struct Adjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> faces;
+
+    std::span<uint32_t const> of(int vertex) const {
+        return std::span<uint32_t const>{faces}.subspan(offsets[vertex], offsets[vertex + 1] - offsets[vertex]);
+    }
+};
+
+Adjacency buildAdjacency(std::span<Face const> faces, std::span<uint8_t const> usable, size_t vertexCount) {
+    Adjacency adjacency;
+    adjacency.offsets.assign(vertexCount + 1, 0);
+
+    for (size_t face = 0; face < faces.size(); ++face) {
+        if (!usable[face]) continue;
+        for (auto const & index : faces[face].indexes) {
+            ++adjacency.offsets[index.vertex + 1];
+        }
+    }
+    for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+        adjacency.offsets[vertex + 1] += adjacency.offsets[vertex];
+    }
+
+    adjacency.faces.resize(adjacency.offsets.back());
+    std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t face = 0; face < faces.size(); ++face) {
+        if (!usable[face]) continue;
+        for (auto const & index : faces[face].indexes) {
+            adjacency.faces[fill[index.vertex]++] = static_cast<uint32_t>(face);
+        }
+    }
+    return adjacency;
+}
+
+// Face order of the Tipsify algorithm. Faces with a vertex index out of
+// range are left at the end in their original order.
+std::vector<uint32_t> tipsify(std::span<Face const> faces, size_t vertexCount, unsigned cacheSize) {
+
+    std::vector<uint8_t> usable(faces.size());
+    for (size_t face = 0; face < faces.size(); ++face) {
+        usable[face] = std::all_of(faces[face].indexes.begin(), faces[face].indexes.end(), [&](auto const & index) {
+            return inRange(index.vertex, vertexCount);
+        });
+    }
+
+    const Adjacency adjacency = buildAdjacency(faces, usable, vertexCount);
+
+    // Live triangles per vertex and the time each vertex entered the cache
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+        liveTriangles[vertex] = adjacency.offsets[vertex + 1] - adjacency.offsets[vertex];
+    }
+    std::vector<int64_t> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(faces.size(), 0);
+    std::vector<int> deadEnds;
+    std::vector<int> candidates;
+
+    std::vector<uint32_t> order;
+    order.reserve(faces.size());
+
+    int64_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int fanning = vertexCount > 0 ? 0 : -1;
+
+    while (fanning >= 0) {
+        candidates.clear();
+
+        for (uint32_t face : adjacency.of(fanning)) {
+            if (emitted[face]) continue;
+            emitted[face] = 1;
+            order.emplace_back(face);
+
+            for (auto const & index : faces[face].indexes) {
+                const int vertex = index.vertex;
+                deadEnds.emplace_back(vertex);
+                candidates.emplace_back(vertex);
+                --liveTriangles[vertex];
+                if (time - cacheTime[vertex] > cacheSize) {
+                    cacheTime[vertex] = time++;
+                }
+            }
+        }
+
+        // Next fanning vertex: the candidate with live triangles that stays
+        // in the cache the longest while they are emitted
+        fanning = -1;
+        int64_t best = -1;
+        for (int vertex : candidates) {
+            if (liveTriangles[vertex] == 0) continue;
+            int64_t priority = 0;
+            if (time - cacheTime[vertex] + 2*int64_t{liveTriangles[vertex]} <= cacheSize) {
+                priority = time - cacheTime[vertex];
+            }
+            if (priority > best) {
+                best = priority;
+                fanning = vertex;
+            }
+        }
+
+        // Dead end: back to a recently used vertex, else the next live one
+        while (fanning < 0 && !deadEnds.empty()) {
+            const int vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0) fanning = vertex;
+        }
+        for (; fanning < 0 && cursor < vertexCount; ++cursor) {
+            if (liveTriangles[cursor] > 0) fanning = static_cast<int>(cursor);
+        }
+    }
+
+    for (size_t face = 0; face < faces.size(); ++face) {
+        if (!usable[face]) order.emplace_back(static_cast<uint32_t>(face));
+    }
+    return order;
+}
+
+// Old to new index in first use order, unused elements numbered last.
+class FirstUseOrder {
+
+public:
+
+    explicit FirstUseOrder(size_t count) :
+    _remap(count, simplegl::kNoIndex) {
+    }
+
+    int operator()(int index) {
+        if (!inRange(index, _remap.size())) {
+            return index;
+        }
+        if (_remap[index] == simplegl::kNoIndex) {
+            _remap[index] = _next++;
+        }
+        return _remap[index];
+    }
+
+    template <typename T>
+    std::vector<T> apply(std::span<T const> values) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            (*this)(static_cast<int>(i));
+        }
+        std::vector<T> result(values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            result[_remap[i]] = values[i];
+        }
+        return result;
+    }
+
+private:
+
+    std::vector<int> _remap;
+    int _next = 0;
+
+};
+
+}
+
+namespace simplegl
+{
+
+VertexCacheStats measureVertexCache(std::span<Face const> faces, unsigned cacheSize) {
+
+    int maxVertex = -1;
+    for (Face const & face : faces) {
+        for (auto const & index : face.indexes) {
+            maxVertex = std::max(maxVertex, index.vertex);
+        }
+    }
+
+    // Time each vertex entered the cache; a vertex is cached while fewer
+    // than cacheSize misses happened since
+    std::vector<int64_t> entered(static_cast<size_t>(maxVertex + 1), -1);
+    int64_t misses = 0;
+    size_t referenced = 0;
+
+    for (Face const & face : faces) {
+        for (auto const & index : face.indexes) {
+            if (index.vertex < 0) continue;
+            int64_t & time = entered[index.vertex];
+            if (time < 0) ++referenced;
+            if (time < 0 || misses - time >= cacheSize) {
+                time = misses++;
+            }
+        }
+    }
+
+    VertexCacheStats stats;
+    if (!faces.empty()) stats.acmr = static_cast<double>(misses)/faces.size();
+    if (referenced > 0) stats.atvr = static_cast<double>(misses)/referenced;
+    return stats;
+}
+
+Mesh optimizeVertexCache(Mesh const & mesh, unsigned cacheSize) {
+
+    const auto faces = mesh.faces();
+    std::vector<uint32_t> order = tipsify(faces, mesh.vertices().size(), std::max(cacheSize, 3u));
+
+    // Tipsify is greedy and loses to strip-like input orders, around high
+    // valence vertexes for instance: keep whichever order misses less
+    std::vector<Face> reordered;
+    reordered.reserve(faces.size());
+    for (uint32_t face : order) {
+        reordered.emplace_back(faces[face]);
+    }
+    if (measureVertexCache(reordered, cacheSize).acmr >= measureVertexCache(faces, cacheSize).acmr) {
+        for (uint32_t face = 0; face < order.size(); ++face) {
+            order[face] = face;
+        }
+    }
+
+    FirstUseOrder vertexes(mesh.vertices().size());
+    FirstUseOrder textureUVs(mesh.textureUVs().size());
+    FirstUseOrder normals(mesh.normals().size());
+
+    std::vector<Face> optimizedFaces;
+    optimizedFaces.reserve(faces.size());
+    for (uint32_t face : order) {
+        Face optimized = faces[face];
+        for (auto & index : optimized.indexes) {
+            index.vertex = vertexes(index.vertex);
+            index.texture = textureUVs(index.texture);
+            index.normal = normals(index.normal);
+        }
+        optimizedFaces.emplace_back(optimized);
+    }
+
+    return Mesh(
+        vertexes.apply(mesh.vertices()),
+        textureUVs.apply(mesh.textureUVs()),
+        normals.apply(mesh.normals()),
+        std::move(optimizedFaces));
+}
+
+}